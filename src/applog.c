@@ -0,0 +1,258 @@
+/** @file applog.c
+ * @brief Implementation of the deferred application log
+ *
+ * applog_put() only copies a record into a
+ * message queue and never waits, so the time
+ * a handler spends logging does not depend on
+ * the UART. The formatting and the console
+ * output are done by applog_thread, which runs
+ * at the lowest application priority.
+ *
+ * The same thread sends the telemetry frames
+ * every CONFIG_APP_TELEMETRY_PERIOD_MS, except
+ * while the machine is parked.
+ *
+ * With CONFIG_APP_DISPLAY the text records
+ * update the display model of display.c instead,
+ * and the thread sends its changes at most
+ * CONFIG_APP_DISPLAY_FPS times per second.
+ *
+ * With CONFIG_APP_UART_TX_ASYNC everything the
+ * thread sends goes through the double buffered
+ * DMA path of uart_tx.c instead of printk and
+ * uart_poll_out(). The time the thread spends
+ * writing is measured either way, so 'W' on the
+ * command channel compares the two paths.
+ *
+ * Binary frame (CONFIG_APP_LOG_BINARY), 8 bytes:
+ * APPLOG_SYNC, id, product (le16), credit (le32)
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#include <zephyr.h>
+#include <device.h>
+#include <devicetree.h>
+#include <drivers/uart.h>
+#include <sys/printk.h>
+#include <sys/byteorder.h>
+#include <timing/timing.h>
+
+#include "applog.h"
+#include "display.h"
+#include "power.h"
+#include "telemetry.h"
+#include "uart_tx.h"
+#include "vending.h"
+
+#define APPLOG_STACK_SIZE 1024 /* Stack of the log thread, printk formatting needs most of it */
+#define APPLOG_PRIORITY K_LOWEST_APPLICATION_THREAD_PRIO
+
+/* The display model replaces the text lines, binary frames are left as they are */
+#if defined(CONFIG_APP_DISPLAY) && !defined(CONFIG_APP_LOG_BINARY)
+#define APPLOG_DISPLAY 1
+#define APPLOG_FRAME_MS (1000 / CONFIG_APP_DISPLAY_FPS) /* Shortest time between two frames */
+#else
+#define APPLOG_DISPLAY 0
+#endif
+
+K_MSGQ_DEFINE(applog_msgq, sizeof(struct applog_record), APPLOG_QUEUE_LEN, 4);
+
+static struct applog_stats stats; /* Counters, see applog_stats_get() */
+
+/**
+ * @brief applog_put function queue a log record
+ *
+ * applog_put is called by the state handlers.
+ * It never blocks: if the queue is full the
+ * record is dropped and counted.
+ *
+ * @param id message id (APPLOG_xxx)
+ * @param product product the message refers to
+ * @param credit credit in cents
+ */
+
+void applog_put(uint8_t id, int16_t product, int32_t credit){
+    struct applog_record rec = { .id = id, .product = product, .credit = credit };
+    timing_t start = timing_counter_get();
+    timing_t end;
+    uint32_t ns;
+
+    if (k_msgq_put(&applog_msgq, &rec, K_NO_WAIT) == 0) {
+        stats.records++;
+    } else {
+        stats.dropped++;
+    }
+
+    end = timing_counter_get();
+    ns = (uint32_t)timing_cycles_to_ns(timing_cycles_get(&start, &end));
+    if (ns > stats.max_put_ns) {
+        stats.max_put_ns = ns;
+    }
+}
+
+/**
+ * @brief applog_stats_get function read the log counters
+ *
+ * @param out where the counters are copied
+ */
+
+void applog_stats_get(struct applog_stats *out){
+    *out = stats;
+}
+
+#ifdef CONFIG_APP_LOG_BINARY
+
+/**
+ * @brief applog_write function send a record as a binary frame
+ *
+ * @param rec record to send
+ * @return number of bytes sent
+ */
+
+static int applog_write(const struct applog_record *rec){
+    static const struct device *uart __maybe_unused = DEVICE_DT_GET(DT_CHOSEN(zephyr_console));
+    uint8_t frame[8];
+
+    frame[0] = APPLOG_SYNC;
+    frame[1] = rec->id;
+    sys_put_le16(rec->product, &frame[2]);
+    sys_put_le32(rec->credit, &frame[4]);
+#ifdef CONFIG_APP_UART_TX_ASYNC
+    uart_tx_write(frame, sizeof(frame));
+#else
+    for (size_t i = 0; i < sizeof(frame); i++) {
+        uart_poll_out(uart, frame[i]);
+    }
+#endif
+    return sizeof(frame);
+}
+
+#elif !APPLOG_DISPLAY
+
+/**
+ * @brief applog_write function print a record as text
+ *
+ * @param rec record to print
+ * @return number of bytes printed
+ */
+
+static int applog_write(const struct applog_record *rec){
+    char line[96];
+    int len = applog_format(rec, line, sizeof(line));
+
+    if (len > 0) {
+#ifdef CONFIG_APP_UART_TX_ASYNC
+        uart_tx_write(line, len);
+#else
+        printk("%s", line);
+#endif
+    }
+    return len;
+}
+
+#endif /* CONFIG_APP_LOG_BINARY */
+
+/**
+ * @brief applog_report function print the cost of the output path
+ *
+ * The handlers only pay applog_put(); the
+ * log thread pays the formatting and the
+ * hand off to the UART, per byte sent.
+ *
+ */
+
+void applog_report(void){
+    printk("Log: %u records, %u dropped, %u bytes\n", stats.records, stats.dropped, stats.bytes);
+    printk("Handlers: worst applog_put %u ns\n", stats.max_put_ns);
+    printk("Log thread (%s): %u ns per byte, worst write %u us\n",
+           IS_ENABLED(CONFIG_APP_UART_TX_ASYNC) ? "async UART" : "poll out",
+           (uint32_t)(stats.write_ns / MAX(stats.bytes, 1)), stats.max_write_ns / 1000);
+#ifdef CONFIG_APP_UART_TX_ASYNC
+    uart_tx_report();
+#endif
+}
+
+/**
+ * @brief applog_timed function account the time of a write
+ *
+ * @param start when the write began
+ */
+
+static void applog_timed(timing_t start){
+    timing_t end = timing_counter_get();
+    uint64_t ns = timing_cycles_to_ns(timing_cycles_get(&start, &end));
+
+    stats.write_ns += ns;
+    stats.max_write_ns = MAX(stats.max_write_ns, (uint32_t)ns);
+}
+
+/**
+ * @brief applog_thread function drain the log queue
+ *
+ * applog_thread waits for records and writes
+ * them to the console. Being the lowest priority
+ * application thread, it only runs when the state
+ * machine has nothing to do.
+ *
+ */
+
+static void applog_thread(void){
+    struct applog_record rec;
+    int64_t next_frame = k_uptime_get() + CONFIG_APP_TELEMETRY_PERIOD_MS;
+#if APPLOG_DISPLAY
+    int64_t next_display = 0; /* Earliest time of the next display frame */
+#endif
+
+    while (1) {
+        int64_t deadline = INT64_MAX;
+        k_timeout_t wait = K_FOREVER;
+
+        /* Parked, the next record (a press) brings the frames back */
+        if (CONFIG_APP_TELEMETRY_PERIOD_MS > 0 && !power_parked()) {
+            deadline = next_frame;
+        }
+#if APPLOG_DISPLAY
+        if (display_dirty()) {
+            deadline = MIN(deadline, next_display);
+        }
+#endif
+        if (deadline != INT64_MAX) {
+            wait = K_MSEC(MAX(deadline - k_uptime_get(), 0));
+        }
+        if (k_msgq_get(&applog_msgq, &rec, wait) == 0) {
+#if APPLOG_DISPLAY
+            display_apply(&rec);
+#else
+            timing_t start = timing_counter_get();
+
+            stats.bytes += applog_write(&rec);
+            applog_timed(start);
+#endif
+        }
+#if APPLOG_DISPLAY
+        /* Send when the records of the transaction are in, or when the frame is late */
+        if (display_dirty() && k_uptime_get() >= next_display &&
+            (k_msgq_num_used_get(&applog_msgq) == 0 ||
+             k_uptime_get() >= next_display + APPLOG_FRAME_MS)) {
+            timing_t start = timing_counter_get();
+
+            stats.bytes += display_flush();
+            applog_timed(start);
+            next_display = k_uptime_get() + APPLOG_FRAME_MS;
+        }
+#endif
+        if (CONFIG_APP_TELEMETRY_PERIOD_MS > 0 && k_uptime_get() >= next_frame &&
+            !power_parked()) {
+            telemetry_write();
+            next_frame += CONFIG_APP_TELEMETRY_PERIOD_MS;
+            /* After a park, one frame and not the ones missed */
+            next_frame = MAX(next_frame, k_uptime_get() + 1);
+        }
+    }
+}
+
+K_THREAD_DEFINE(applog_tid, APPLOG_STACK_SIZE, applog_thread, NULL, NULL, NULL,
+                APPLOG_PRIORITY, 0, 0);
@@ -0,0 +1,58 @@
+/** @file applog.h
+ * @brief Declarations of the deferred application log
+ *
+ * The state handlers do not format text: they
+ * queue a small binary record made of a message
+ * id and its arguments. A low priority thread
+ * drains the queue to the console, either as
+ * text or, with CONFIG_APP_LOG_BINARY, as binary frames
+ * decoded on the host by tools/applog_decode.py.
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#ifndef APPLOG_H
+#define APPLOG_H
+
+#include <zephyr.h>
+
+#define APPLOG_QUEUE_LEN 32 /* Records that can wait for the log thread */
+#define APPLOG_SYNC 0xA5 /* First byte of a binary frame */
+
+/*Define of message ids*/
+#define APPLOG_PRODUCT 0 /* "<name>: <price> EUR" and "Credit: <credit> EUR" */
+#define APPLOG_CREDIT 1 /* "Credit: <credit> EUR" */
+#define APPLOG_RETURN 2 /* "<credit> EUR credit return" */
+#define APPLOG_SOLD_OUT 3 /* "Product <name> sold out, credit is <credit> EUR" */
+#define APPLOG_NO_CREDIT 4 /* "Not enough credit, product <name> cost <price> EUR, credit is <credit> EUR" */
+#define APPLOG_DISPENSED 5 /* "Product <name> dispensed, remaining credit <credit> EUR" */
+#define APPLOG_CHANGE 6 /* "<credit> EUR change" */
+#define APPLOG_EXACT_CHANGE 7 /* "Exact change only" if credit is 1, "Change available" if 0 */
+#define APPLOG_STATE 8 /* "State <state>, credit <credit> EUR", the state is in product */
+#define APPLOG_BUSY 9 /* "Dispenser busy, product <name> not sold, credit is <credit> EUR" */
+
+/* Record queued by the state handlers */
+struct applog_record {
+    uint8_t id; /* Message id */
+    int16_t product; /* Product (sel_prod) the message refers to */
+    int32_t credit; /* Credit in cents */
+};
+
+/* Counters of the application log */
+struct applog_stats {
+    uint32_t records; /* Records queued */
+    uint32_t dropped; /* Records lost because the queue was full */
+    uint32_t bytes; /* Bytes sent to the console */
+    uint32_t max_put_ns; /* Worst time spent in applog_put() */
+    uint64_t write_ns; /* Time the log thread spent formatting and sending the bytes */
+    uint32_t max_write_ns; /* Worst time of one record or display frame */
+};
+
+void applog_put(uint8_t id, int16_t product, int32_t credit);
+void applog_stats_get(struct applog_stats *stats);
+int applog_format(const struct applog_record *rec, char *line, size_t size);
+void applog_report(void);
+
+#endif /* APPLOG_H */
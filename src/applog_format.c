@@ -0,0 +1,80 @@
+/** @file applog_format.c
+ * @brief Text of the application log records
+ *
+ * Kept apart from the log thread of applog.c, so
+ * that the display model and the benchmarks of
+ * tests/benchmarks/fsm can format a record
+ * without the thread, the queue and the UART.
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#include <zephyr.h>
+#include <sys/printk.h>
+
+#include "applog.h"
+#include "catalog.h"
+#include "machine.h"
+
+/**
+ * @brief applog_format function format a record as text
+ *
+ * The text is the same printed by the
+ * state handlers before the log was deferred.
+ *
+ * @param rec record to format
+ * @param line where the text is written
+ * @param size size of line
+ * @return length of the text, 0 for an unknown record
+ */
+
+int applog_format(const struct applog_record *rec, char *line, size_t size){
+    int credit = rec->credit;
+    int len = 0;
+    const struct product *prod = catalog_lookup(rec->product);
+
+    switch (rec->id) {
+    case APPLOG_PRODUCT:
+        len = snprintk(line, size, "%s: %d.%02d EUR\nCredit: %d.%d EUR\n",
+                       prod->name, prod->price/100, prod->price%100, credit/100, credit%100);
+        break;
+    case APPLOG_CREDIT:
+        len = snprintk(line, size, "Credit: %d.%d EUR\n", credit/100, credit%100);
+        break;
+    case APPLOG_RETURN:
+        len = snprintk(line, size, "%d.%d EUR credit return\n", credit/100, credit%100);
+        break;
+    case APPLOG_SOLD_OUT:
+        len = snprintk(line, size, "Product %s sold out, credit is %d.%d EUR\n",
+                       prod->name, credit/100, credit%100);
+        break;
+    case APPLOG_NO_CREDIT:
+        len = snprintk(line, size, "Not enough credit, product %s cost %d.%02d EUR, credit is %d.%d EUR\n",
+                       prod->name, prod->price/100, prod->price%100, credit/100, credit%100);
+        break;
+    case APPLOG_DISPENSED:
+        len = snprintk(line, size, "Product %s dispensed, remaining credit %d.%d EUR\n",
+                       prod->name, credit/100, credit%100);
+        break;
+    case APPLOG_CHANGE:
+        len = snprintk(line, size, "%d.%d EUR change\n", credit/100, credit%100);
+        break;
+    case APPLOG_EXACT_CHANGE:
+        len = snprintk(line, size, "%s\n", credit ? "Exact change only" : "Change available");
+        break;
+    case APPLOG_BUSY:
+        len = snprintk(line, size, "Dispenser busy, product %s not sold, credit is %d.%d EUR\n",
+                       prod->name, credit/100, credit%100);
+        break;
+    case APPLOG_STATE:
+        len = snprintk(line, size, "State %s, credit %d.%d EUR\n",
+                       machine_state_name(rec->product), credit/100, credit%100);
+        break;
+    default:
+        return 0;
+    }
+
+    return MIN(len, (int)size - 1);
+}
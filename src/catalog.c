@@ -0,0 +1,175 @@
+/** @file catalog.c
+ * @brief Implementation of the product catalog
+ *
+ * Besides the product table, this file keeps,
+ * for each machine, the stock of each slot and
+ * a bitmask of the products that its credit
+ * can pay.
+ * The bitmask is updated incrementally every
+ * time the credit changes: products are visited
+ * in price order and only the ones whose price
+ * lies between the old and the new credit are
+ * touched.
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#include <string.h>
+
+#include "catalog.h"
+
+/* Products, sel_prod n is at index n-1 */
+static const struct product catalog[CATALOG_SIZE] = {
+    { .name = "Beer", .price = 150, .slot = 1, .stock = 20 },
+    { .name = "Tuna sandwich", .price = 100, .slot = 2, .stock = 20 },
+    { .name = "Coffee", .price = 50, .slot = 3, .stock = 20 },
+};
+
+/* Stands for a product out of range in the log records */
+static const struct product unknown = { .name = "?" };
+
+static uint16_t by_price[CATALOG_SIZE]; /* Catalog indexes sorted by increasing price */
+
+/**
+ * @brief catalog_init function prepare the catalog
+ *
+ * catalog_init sorts the products by price.
+ * It must be called once, before any other
+ * catalog function.
+ *
+ */
+
+void catalog_init(void){
+    for (int i = 0; i < CATALOG_SIZE; i++) {
+        int j = i;
+
+        /* Insertion sort, done only once at boot */
+        while (j > 0 && catalog[by_price[j - 1]].price > catalog[i].price) {
+            by_price[j] = by_price[j - 1];
+            j--;
+        }
+        by_price[j] = i;
+    }
+}
+
+/**
+ * @brief catalog_fill function fill every slot of a machine
+ *
+ * The credit is assumed to be zero.
+ *
+ * @param cs stock of the machine
+ */
+
+void catalog_fill(struct catalog_state *cs){
+    memset(cs, 0, sizeof(*cs));
+    for (int i = 0; i < CATALOG_SIZE; i++) {
+        cs->stock[i] = catalog[i].stock;
+    }
+    catalog_credit_changed(cs, 0);
+}
+
+/**
+ * @brief catalog_get function return a product
+ *
+ * @param sel_prod selected product, from 1 to CATALOG_SIZE
+ * @return description of the product
+ */
+
+const struct product *catalog_get(int sel_prod){
+    __ASSERT_NO_MSG(sel_prod >= 1 && sel_prod <= CATALOG_SIZE);
+    return &catalog[sel_prod - 1];
+}
+
+/**
+ * @brief catalog_lookup function return a product, checking the range
+ *
+ * @param sel_prod product number, possibly out of range
+ * @return description of the product, a "?" costing 0 if out of range
+ */
+
+const struct product *catalog_lookup(int sel_prod){
+    if (sel_prod < 1 || sel_prod > CATALOG_SIZE) {
+        return &unknown;
+    }
+    return &catalog[sel_prod - 1];
+}
+
+/**
+ * @brief catalog_stock function return the items left of a product
+ *
+ * @param cs stock of the machine
+ * @param sel_prod selected product, from 1 to CATALOG_SIZE
+ * @return number of items left in the slot
+ */
+
+uint16_t catalog_stock(const struct catalog_state *cs, int sel_prod){
+    return cs->stock[sel_prod - 1];
+}
+
+/**
+ * @brief catalog_take function remove an item of a product
+ *
+ * @param cs stock of the machine
+ * @param sel_prod selected product, from 1 to CATALOG_SIZE
+ * @return false if the slot is empty
+ */
+
+bool catalog_take(struct catalog_state *cs, int sel_prod){
+    if (cs->stock[sel_prod - 1] == 0) {
+        return false;
+    }
+    cs->stock[sel_prod - 1]--;
+    return true;
+}
+
+/**
+ * @brief catalog_restore function set the items left after a reset
+ *
+ * @param cs stock of the machine
+ * @param saved items left in each slot, product 1 first
+ */
+
+void catalog_restore(struct catalog_state *cs, const uint16_t saved[CATALOG_SIZE]){
+    memcpy(cs->stock, saved, sizeof(cs->stock));
+}
+
+/**
+ * @brief catalog_credit_changed function update the affordable products
+ *
+ * catalog_credit_changed must be called every
+ * time the credit changes. It moves the
+ * boundary in by_price up or down and sets
+ * or clears only the bits that change.
+ *
+ * @param cs stock of the machine
+ * @param credit new credit in cents
+ */
+
+void catalog_credit_changed(struct catalog_state *cs, int credit){
+    uint16_t i;
+
+    while (cs->n_affordable < CATALOG_SIZE && catalog[by_price[cs->n_affordable]].price <= credit) {
+        i = by_price[cs->n_affordable++];
+        cs->affordable[i / 32] |= BIT(i % 32);
+    }
+    while (cs->n_affordable > 0 && catalog[by_price[cs->n_affordable - 1]].price > credit) {
+        i = by_price[--cs->n_affordable];
+        cs->affordable[i / 32] &= ~BIT(i % 32);
+    }
+}
+
+/**
+ * @brief catalog_affordable function check the price of a product
+ *
+ * @param cs stock of the machine
+ * @param sel_prod selected product, from 1 to CATALOG_SIZE
+ * @return true if the current credit can pay the product
+ */
+
+bool catalog_affordable(const struct catalog_state *cs, int sel_prod){
+    int i = sel_prod - 1;
+
+    return (cs->affordable[i / 32] & BIT(i % 32)) != 0;
+}
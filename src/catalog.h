@@ -0,0 +1,47 @@
+/** @file catalog.h
+ * @brief Declarations of the product catalog
+ *
+ * Products are described by a const table
+ * indexed by the selected product (sel_prod),
+ * so every lookup is a direct array access.
+ * The table is shared; the stock and the
+ * affordable products belong to each machine.
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <zephyr.h>
+
+#define CATALOG_SIZE 3 /* Number of products, sel_prod goes from 1 to CATALOG_SIZE */
+
+/* Description of a product */
+struct product {
+    const char *name; /* Name printed on the display */
+    uint16_t price; /* Price in cents */
+    uint16_t slot; /* Slot of the cabinet holding the product */
+    uint16_t stock; /* Number of items after a refill */
+};
+
+/* Stock and affordable products of one machine */
+struct catalog_state {
+    uint16_t stock[CATALOG_SIZE]; /* Items left in each slot */
+    uint16_t n_affordable; /* The first n_affordable products by price can be paid */
+    uint32_t affordable[(CATALOG_SIZE + 31) / 32]; /* Bit i set if product i can be paid */
+};
+
+void catalog_init(void);
+void catalog_fill(struct catalog_state *cs);
+const struct product *catalog_get(int sel_prod);
+const struct product *catalog_lookup(int sel_prod);
+uint16_t catalog_stock(const struct catalog_state *cs, int sel_prod);
+bool catalog_take(struct catalog_state *cs, int sel_prod);
+void catalog_restore(struct catalog_state *cs, const uint16_t saved[CATALOG_SIZE]);
+void catalog_credit_changed(struct catalog_state *cs, int credit);
+bool catalog_affordable(const struct catalog_state *cs, int sel_prod);
+
+#endif /* CATALOG_H */
@@ -0,0 +1,267 @@
+/** @file change.c
+ * @brief Implementation of the change engine
+ *
+ * The engine knows how many coins of each value
+ * are in the tubes of a machine. At boot it
+ * computes, once for all the machines, for
+ * every amount up to CHANGE_MAX_UNITS, the payout
+ * with the fewest coins when the tubes are not a
+ * limit, so a normal payout is one table lookup.
+ * Only when a tube is too low for the table entry
+ * a bounded search over the coins actually held
+ * is done; if the exact amount cannot be paid,
+ * the largest amount below it is paid and the
+ * rest is left as credit.
+ *
+ * The machine is in "exact change only" when
+ * some amount below 1 EUR cannot be paid back.
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#include <limits.h>
+#include <string.h>
+
+#include "change.h"
+
+/* Value of each coin in units of CHANGE_UNIT */
+static const uint8_t coin_units[CHANGE_N_COINS] = { 1, 2, 5, 10 };
+
+static struct change_coins table[CHANGE_MAX_UNITS + 1]; /* Fewest coins payout of each amount */
+
+/**
+ * @brief change_search function fewest coins payout with the coins held
+ *
+ * Every number of 1 EUR and 50 cent coins is
+ * tried; for the rest, using as many 20 cent
+ * coins as possible is always best. The loops
+ * are bounded by the amount.
+ *
+ * @param t tubes of the machine
+ * @param units amount in units of CHANGE_UNIT
+ * @param out payout found
+ * @return true if the amount can be paid exactly
+ */
+
+static bool change_search(const struct change_tubes *t, int units, struct change_coins *out){
+    int best = INT_MAX;
+
+    for (int n100 = MIN(t->n[3], units / 10); n100 >= 0; n100--) {
+        int r100 = units - n100 * 10;
+
+        for (int n50 = MIN(t->n[2], r100 / 5); n50 >= 0; n50--) {
+            int r50 = r100 - n50 * 5;
+            int n20 = MIN(t->n[1], r50 / 2);
+            int n10 = r50 - n20 * 2;
+
+            if (n10 <= t->n[0] && n100 + n50 + n20 + n10 < best) {
+                best = n100 + n50 + n20 + n10;
+                out->n[0] = n10;
+                out->n[1] = n20;
+                out->n[2] = n50;
+                out->n[3] = n100;
+            }
+        }
+    }
+    return best != INT_MAX;
+}
+
+/**
+ * @brief change_fits function check a payout against the tubes
+ *
+ * @param t tubes of the machine
+ * @param coins payout
+ * @return true if the tubes hold the coins
+ */
+
+static bool change_fits(const struct change_tubes *t, const struct change_coins *coins){
+    for (int i = 0; i < CHANGE_N_COINS; i++) {
+        if (coins->n[i] > t->n[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief change_update_exact function update the exact change flag
+ *
+ * @param t tubes of the machine
+ */
+
+static void change_update_exact(struct change_tubes *t){
+    struct change_coins coins;
+
+    t->exact_only = false;
+    for (int units = 1; units < coin_units[CHANGE_N_COINS - 1]; units++) {
+        if (!change_fits(t, &table[units]) && !change_search(t, units, &coins)) {
+            t->exact_only = true;
+            return;
+        }
+    }
+}
+
+/**
+ * @brief change_init function build the payout table
+ *
+ * The table is the classic coin change dynamic
+ * programming, done once at boot before any
+ * other change function.
+ *
+ */
+
+void change_init(void){
+    uint8_t count[CHANGE_MAX_UNITS + 1];
+
+    count[0] = 0;
+    memset(&table[0], 0, sizeof(table[0]));
+    for (int units = 1; units <= CHANGE_MAX_UNITS; units++) {
+        count[units] = UINT8_MAX;
+        for (int i = 0; i < CHANGE_N_COINS; i++) {
+            if (coin_units[i] <= units && count[units - coin_units[i]] + 1 < count[units]) {
+                count[units] = count[units - coin_units[i]] + 1;
+                table[units] = table[units - coin_units[i]];
+                table[units].n[i]++;
+            }
+        }
+    }
+}
+
+/**
+ * @brief change_fill function load the tubes of a machine
+ *
+ * @param t tubes of the machine
+ */
+
+void change_fill(struct change_tubes *t){
+    for (int i = 0; i < CHANGE_N_COINS; i++) {
+        t->n[i] = CHANGE_TUBE_FILL;
+    }
+    change_update_exact(t);
+}
+
+/**
+ * @brief change_coin_in function store an inserted coin
+ *
+ * @param t tubes of the machine
+ * @param cents value of the coin
+ */
+
+void change_coin_in(struct change_tubes *t, int cents){
+    for (int i = 0; i < CHANGE_N_COINS; i++) {
+        if (coin_units[i] * CHANGE_UNIT == cents) {
+            if (t->n[i] < CHANGE_TUBE_CAPACITY) {
+                t->n[i]++;
+                if (t->exact_only) {
+                    change_update_exact(t);
+                }
+            }
+            return;
+        }
+    }
+}
+
+/**
+ * @brief change_pay function pay an amount back to the customer
+ *
+ * The coins are taken from the tubes. If the
+ * amount cannot be paid exactly, the largest
+ * amount below it that can be paid is paid.
+ *
+ * @param t tubes of the machine
+ * @param amount amount to pay, in cents
+ * @param paid coins paid, can be NULL
+ * @return amount paid, in cents
+ */
+
+int change_pay(struct change_tubes *t, int amount, struct change_coins *paid){
+    struct change_coins coins = { 0 };
+    struct change_coins rest = { 0 };
+    int units = amount / CHANGE_UNIT;
+
+    /* Amounts above the table start with 1 EUR coins */
+    if (units > CHANGE_MAX_UNITS) {
+        coins.n[3] = MIN(t->n[3], (units - CHANGE_MAX_UNITS + 9) / 10);
+        t->n[3] -= coins.n[3];
+        units -= coins.n[3] * 10;
+    }
+
+    if (units <= CHANGE_MAX_UNITS && change_fits(t, &table[units])) {
+        rest = table[units];
+    } else {
+        /* Tubes too low for the table, pay the most that can be paid */
+        while (units > 0 && !change_search(t, units, &rest)) {
+            units--;
+        }
+    }
+
+    amount = 0;
+    for (int i = 0; i < CHANGE_N_COINS; i++) {
+        if (units > 0) {
+            t->n[i] -= rest.n[i];
+            coins.n[i] += rest.n[i];
+        }
+        amount += coins.n[i] * coin_units[i] * CHANGE_UNIT;
+    }
+    change_update_exact(t);
+
+    if (paid != NULL) {
+        *paid = coins;
+    }
+    return amount;
+}
+
+/**
+ * @brief change_take function remove coins already paid
+ *
+ * Used when replaying the journal, where the
+ * coins of each payout are recorded.
+ *
+ * @param t tubes of the machine
+ * @param coins coins paid
+ */
+
+void change_take(struct change_tubes *t, const struct change_coins *coins){
+    for (int i = 0; i < CHANGE_N_COINS; i++) {
+        t->n[i] -= MIN(coins->n[i], t->n[i]);
+    }
+    change_update_exact(t);
+}
+
+/**
+ * @brief change_exact_only function read the exact change flag
+ *
+ * @param t tubes of the machine
+ * @return true if the machine cannot always give change
+ */
+
+bool change_exact_only(const struct change_tubes *t){
+    return t->exact_only;
+}
+
+/**
+ * @brief change_tubes_get function read the coins held
+ *
+ * @param t tubes of the machine
+ * @param tubes_out coins of each denomination, 10 cents first
+ */
+
+void change_tubes_get(const struct change_tubes *t, uint16_t tubes_out[CHANGE_N_COINS]){
+    memcpy(tubes_out, t->n, sizeof(t->n));
+}
+
+/**
+ * @brief change_tubes_set function set the coins held after a reset
+ *
+ * @param t tubes of the machine
+ * @param saved coins of each denomination, 10 cents first
+ */
+
+void change_tubes_set(struct change_tubes *t, const uint16_t saved[CHANGE_N_COINS]){
+    for (int i = 0; i < CHANGE_N_COINS; i++) {
+        t->n[i] = MIN(saved[i], CHANGE_TUBE_CAPACITY);
+    }
+    change_update_exact(t);
+}
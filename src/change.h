@@ -0,0 +1,40 @@
+/** @file change.h
+ * @brief Declarations of the change engine
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#ifndef CHANGE_H
+#define CHANGE_H
+
+#include <zephyr.h>
+
+#define CHANGE_N_COINS 4 /* 10, 20, 50 cents and 1 EUR */
+#define CHANGE_UNIT 10 /* Smallest coin, in cents */
+#define CHANGE_MAX_UNITS 100 /* Payouts up to 10 EUR come from the precomputed table */
+#define CHANGE_TUBE_CAPACITY 50 /* Coins held by a tube, the others go to the cash box */
+#define CHANGE_TUBE_FILL 10 /* Coins loaded in each tube at boot */
+
+/* Number of coins of each denomination, 10 cents first */
+struct change_coins {
+    uint8_t n[CHANGE_N_COINS];
+};
+
+/* Coin tubes of one machine */
+struct change_tubes {
+    uint16_t n[CHANGE_N_COINS]; /* Coins held for change, 10 cents first */
+    bool exact_only; /* Some amount below 1 EUR cannot be paid */
+};
+
+void change_init(void);
+void change_fill(struct change_tubes *t);
+void change_coin_in(struct change_tubes *t, int cents);
+int change_pay(struct change_tubes *t, int amount, struct change_coins *paid);
+void change_take(struct change_tubes *t, const struct change_coins *coins);
+bool change_exact_only(const struct change_tubes *t);
+void change_tubes_get(const struct change_tubes *t, uint16_t tubes_out[CHANGE_N_COINS]);
+void change_tubes_set(struct change_tubes *t, const uint16_t saved[CHANGE_N_COINS]);
+
+#endif /* CHANGE_H */
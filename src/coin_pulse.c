@@ -0,0 +1,367 @@
+/** @file coin_pulse.c
+ * @brief Implementation of the pulse train coin acceptor
+ *
+ * The pulses of BOARDCOIN go to a counter that
+ * runs by itself; nothing is timestamped or
+ * debounced per edge. The first pulse of a train
+ * starts a k_timer that reads the counter every
+ * COIN_PULSE_POLL_MS; when the count has not
+ * moved for CONFIG_APP_COIN_PULSE_GAP_MS the
+ * train is over, the pulses since the previous
+ * train give the denomination, and the timer
+ * stops until the next train.
+ *
+ * With CONFIG_APP_COIN_PULSE_HW (nRF52) the
+ * counter is TIMER2 in counter mode, its COUNT
+ * task fired through PPI by a GPIOTE event on
+ * every rising edge: the CPU takes one
+ * interrupt per coin, the compare of the first
+ * pulse. Otherwise, as on native_posix, the GPIO
+ * interrupt of every edge only increments an
+ * atomic counter.
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#include <zephyr.h>
+#include <device.h>
+#include <drivers/gpio.h>
+#include <sys/atomic.h>
+#include <sys/printk.h>
+#ifdef CONFIG_APP_COIN_PULSE_HW
+#include <nrfx_gpiote.h>
+#include <nrfx_timer.h>
+#include <helpers/nrfx_gppi.h>
+#endif
+
+#include "coin_pulse.h"
+#include "power.h"
+#include "vending.h"
+
+/* Denomination of a train, delivered as the press of the coin button */
+struct coin_pulse_denom {
+    uint8_t pulses; /* Length of the train */
+    gpio_pin_t pin; /* Button of the same value */
+};
+
+/* Pulses per coin of the mech, one every 10 cents */
+static const struct coin_pulse_denom denoms[] = {
+    { 1, BOARDBUT5 }, /* 10 cents */
+    { 2, BOARDBUT6 }, /* 20 cents */
+    { 5, BOARDBUT7 }, /* 50 cents */
+    { 10, BOARDBUT8 }, /* 1 EUR */
+};
+
+static void coin_pulse_poll(struct k_timer *timer);
+
+K_TIMER_DEFINE(coin_pulse_timer, coin_pulse_poll, NULL);
+
+static coin_pulse_coin_t on_coin; /* Receiver of the coins */
+static atomic_t in_train = ATOMIC_INIT(0); /* The timer is reading the counter, set by the edge ISRs */
+static uint32_t base=0; /* Counter at the end of the previous train */
+static uint32_t last=0; /* Counter at the previous read */
+static uint32_t quiet_ms=0; /* Time since the counter last moved */
+static timing_t first_edge; /* Time the train was seen */
+static struct coin_pulse_stats stats; /* Counters, see coin_pulse_stats_get() */
+
+static void coin_pulse_start(void);
+
+#ifdef CONFIG_APP_COIN_PULSE_HW
+
+#define COIN_PULSE_TIMER_NODE DT_NODELABEL(timer2)
+
+static const nrfx_timer_t counter = NRFX_TIMER_INSTANCE(2);
+
+/**
+ * @brief coin_pulse_timer_event function first pulse of a train
+ *
+ * @param event TIMER2 event, the compare of CC1
+ * @param context not used
+ */
+
+static void coin_pulse_timer_event(nrf_timer_event_t event, void *context){
+    if (event == NRF_TIMER_EVENT_COMPARE1) {
+        nrfx_timer_compare_int_disable(&counter, NRF_TIMER_CC_CHANNEL1);
+        stats.wakeups++;
+        coin_pulse_start();
+    }
+}
+
+/**
+ * @brief counter_init function wire BOARDCOIN to the COUNT task of TIMER2
+ *
+ * @param port not used, GPIOTE takes the pin
+ * @return 0 on success, a negative errno otherwise
+ */
+
+static int counter_init(const struct device *port){
+    nrfx_timer_config_t config = NRFX_TIMER_DEFAULT_CONFIG;
+    const nrfx_gpiote_input_config_t input = { .pull = NRF_GPIO_PIN_PULLUP };
+    nrfx_gpiote_trigger_config_t trigger = { .trigger = NRFX_GPIOTE_TRIGGER_LOTOHI };
+    uint8_t in_channel;
+    uint8_t ppi_channel;
+
+    config.mode = NRF_TIMER_MODE_COUNTER;
+    config.bit_width = NRF_TIMER_BIT_WIDTH_32;
+    IRQ_CONNECT(DT_IRQN(COIN_PULSE_TIMER_NODE), DT_IRQ(COIN_PULSE_TIMER_NODE, priority),
+                nrfx_isr, nrfx_timer_2_irq_handler, 0);
+    if (nrfx_timer_init(&counter, &config, coin_pulse_timer_event) != NRFX_SUCCESS) {
+        return -EIO;
+    }
+
+    /* The GPIO driver already uses GPIOTE, only a channel is taken */
+    if (!nrfx_gpiote_is_init() && nrfx_gpiote_init(0) != NRFX_SUCCESS) {
+        return -EIO;
+    }
+    if (nrfx_gpiote_channel_alloc(&in_channel) != NRFX_SUCCESS) {
+        return -EBUSY;
+    }
+    trigger.p_in_channel = &in_channel;
+    if (nrfx_gpiote_input_configure(BOARDCOIN, &input, &trigger, NULL) != NRFX_SUCCESS) {
+        return -EIO;
+    }
+    nrfx_gpiote_trigger_enable(BOARDCOIN, false);
+
+    if (nrfx_gppi_channel_alloc(&ppi_channel) != NRFX_SUCCESS) {
+        return -EBUSY;
+    }
+    nrfx_gppi_channel_endpoints_setup(ppi_channel,
+        nrf_gpiote_event_address_get(NRF_GPIOTE, nrf_gpiote_in_event_get(in_channel)),
+        nrfx_timer_task_address_get(&counter, NRF_TIMER_TASK_COUNT));
+    nrfx_gppi_channels_enable(BIT(ppi_channel));
+    nrfx_timer_enable(&counter);
+    return 0;
+}
+
+/**
+ * @brief counter_read function pulses counted since boot
+ *
+ * @return value of TIMER2, captured in CC0
+ */
+
+static uint32_t counter_read(void){
+    return nrfx_timer_capture(&counter, NRF_TIMER_CC_CHANNEL0);
+}
+
+/**
+ * @brief counter_arm function interrupt at the first pulse of the next train
+ *
+ * A pulse that came while the compare was
+ * armed starts the train here, the interrupt
+ * it raised is disabled.
+ *
+ */
+
+static void counter_arm(void){
+    nrfx_timer_compare(&counter, NRF_TIMER_CC_CHANNEL1, base + 1, true);
+    if (counter_read() != base) {
+        nrfx_timer_compare_int_disable(&counter, NRF_TIMER_CC_CHANNEL1);
+        coin_pulse_start();
+    }
+}
+
+#else /* !CONFIG_APP_COIN_PULSE_HW */
+
+static struct gpio_callback coin_cb_data; /* Callback of BOARDCOIN */
+static atomic_t count = ATOMIC_INIT(0); /* Pulses counted since boot */
+
+/**
+ * @brief coin_pulse_edge function count a pulse
+ *
+ * @param dev GPIO device that raised the interrupt
+ * @param cb callback structure (coin_cb_data)
+ * @param pins mask of the pins that triggered
+ */
+
+static void coin_pulse_edge(const struct device *dev, struct gpio_callback *cb,
+                            gpio_port_pins_t pins){
+    atomic_inc(&count);
+    stats.wakeups++;
+    if (!atomic_get(&in_train)) {
+        coin_pulse_start();
+    }
+}
+
+/**
+ * @brief counter_init function interrupt on every rising edge of BOARDCOIN
+ *
+ * @param port GPIO port of BOARDCOIN
+ * @return 0 on success, a negative errno otherwise
+ */
+
+static int counter_init(const struct device *port){
+    int ret = gpio_pin_configure(port, BOARDCOIN, GPIO_INPUT | GPIO_PULL_UP);
+
+    if (ret < 0) {
+        return ret;
+    }
+    ret = gpio_pin_interrupt_configure(port, BOARDCOIN, GPIO_INT_EDGE_TO_ACTIVE);
+    if (ret < 0) {
+        return ret;
+    }
+    gpio_init_callback(&coin_cb_data, coin_pulse_edge, BIT(BOARDCOIN));
+    return gpio_add_callback(port, &coin_cb_data);
+}
+
+/**
+ * @brief counter_read function pulses counted since boot
+ *
+ * @return value of the atomic counter
+ */
+
+static uint32_t counter_read(void){
+    return (uint32_t)atomic_get(&count);
+}
+
+/**
+ * @brief counter_arm function wait for the first pulse of the next train
+ *
+ * The edge interrupt starts the next train;
+ * a pulse already counted starts it here.
+ *
+ */
+
+static void counter_arm(void){
+    if (counter_read() != base) {
+        coin_pulse_start();
+    }
+}
+
+#endif /* CONFIG_APP_COIN_PULSE_HW */
+
+/**
+ * @brief coin_pulse_start function read the counter until the train ends
+ *
+ * Called by the edge interrupt and by the poll
+ * timer ISR, which may preempt each other: only
+ * the caller that sets in_train starts the
+ * train.
+ *
+ */
+
+static void coin_pulse_start(void){
+    if (!atomic_cas(&in_train, 0, 1)) {
+        return;
+    }
+    first_edge = timing_counter_get();
+    power_edge();
+    last = counter_read();
+    quiet_ms = 0;
+    k_timer_start(&coin_pulse_timer, K_MSEC(COIN_PULSE_POLL_MS), K_MSEC(COIN_PULSE_POLL_MS));
+}
+
+/**
+ * @brief coin_pulse_end function turn a train into a coin
+ *
+ * @param pulses length of the train
+ */
+
+static void coin_pulse_end(uint32_t pulses){
+    stats.pulses += pulses;
+    stats.max_pulses = MAX(stats.max_pulses, pulses);
+    for (int i = 0; i < ARRAY_SIZE(denoms); i++) {
+        if (denoms[i].pulses == pulses) {
+            stats.coins++;
+            on_coin(denoms[i].pin, first_edge);
+            return;
+        }
+    }
+    stats.rejected++;
+}
+
+/**
+ * @brief coin_pulse_poll function timer ISR, end a train after the gap
+ *
+ * @param timer coin_pulse_timer
+ */
+
+static void coin_pulse_poll(struct k_timer *timer){
+    uint32_t now = counter_read();
+
+    stats.polls++;
+    if (now != last) {
+        last = now;
+        quiet_ms = 0;
+        return;
+    }
+    quiet_ms += COIN_PULSE_POLL_MS;
+    if (quiet_ms < CONFIG_APP_COIN_PULSE_GAP_MS) {
+        return;
+    }
+
+    k_timer_stop(timer);
+    coin_pulse_end(now - base);
+    base = now;
+    /* An edge from here on starts the next train, or counter_arm() sees it */
+    atomic_clear(&in_train);
+    counter_arm();
+}
+
+/**
+ * @brief coin_pulse_init function start counting the pulses of BOARDCOIN
+ *
+ * @param port GPIO port of BOARDCOIN
+ * @param coin_cb called, from the timer ISR, for every coin
+ * @return 0 on success, a negative errno otherwise
+ */
+
+int coin_pulse_init(const struct device *port, coin_pulse_coin_t coin_cb){
+    int ret;
+
+    on_coin = coin_cb;
+    ret = counter_init(port);
+    if (ret < 0) {
+        printk("Error %d: Failed to configure the coin acceptor\n", ret);
+        return ret;
+    }
+    base = counter_read();
+    counter_arm();
+    return 0;
+}
+
+/**
+ * @brief coin_pulse_pulses function length of the train of a coin
+ *
+ * @param pin coin button, BOARDBUT5 ... BOARDBUT8
+ * @return pulses sent by the mech for that coin, 0 if pin is not a coin
+ */
+
+uint8_t coin_pulse_pulses(gpio_pin_t pin){
+    for (int i = 0; i < ARRAY_SIZE(denoms); i++) {
+        if (denoms[i].pin == pin) {
+            return denoms[i].pulses;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief coin_pulse_stats_get function read the coin acceptor counters
+ *
+ * @param out where the counters are copied
+ */
+
+void coin_pulse_stats_get(struct coin_pulse_stats *out){
+    unsigned int key = irq_lock();
+
+    *out = stats;
+    irq_unlock(key);
+}
+
+/**
+ * @brief coin_pulse_report function print the coin acceptor counters
+ *
+ */
+
+void coin_pulse_report(void){
+    struct coin_pulse_stats now;
+
+    coin_pulse_stats_get(&now);
+    printk("Coin acceptor (%s): %u pulses, %u coins, %u rejected, longest train %u\n",
+           IS_ENABLED(CONFIG_APP_COIN_PULSE_HW) ? "TIMER2 counter" : "edge interrupts",
+           now.pulses, now.coins, now.rejected, now.max_pulses);
+    printk("CPU: %u interrupts and %u counter reads for %u pulses\n", now.wakeups,
+           now.polls, now.pulses);
+}
@@ -0,0 +1,48 @@
+/** @file coin_pulse.h
+ * @brief Declarations of the pulse train coin acceptor
+ *
+ * A coin mech sends N pulses per coin on one
+ * line (BOARDCOIN). The pulses are counted
+ * without any work per edge, a train ends
+ * after CONFIG_APP_COIN_PULSE_GAP_MS without
+ * pulses, and its length is looked up in the
+ * denomination table. A coin is delivered as
+ * the press of the button of its value
+ * (BOARDBUT5 ... BOARDBUT8), so the input ring,
+ * the state machine and the latency see it as
+ * before.
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#ifndef COIN_PULSE_H
+#define COIN_PULSE_H
+
+#include <zephyr.h>
+#include <device.h>
+#include <drivers/gpio.h>
+#include <timing/timing.h>
+
+#define COIN_PULSE_POLL_MS 2 /* Period of the counter reads while a train is running */
+
+/* Called, from the timer ISR, for every coin recognised */
+typedef void (*coin_pulse_coin_t)(gpio_pin_t pin, timing_t first_edge);
+
+/* Counters of the coin acceptor */
+struct coin_pulse_stats {
+    uint32_t pulses; /* Pulses counted in the trains that ended */
+    uint32_t coins; /* Trains recognised as a coin */
+    uint32_t rejected; /* Trains with no denomination, no credit given */
+    uint32_t wakeups; /* Interrupts taken by the counting */
+    uint32_t polls; /* Counter reads */
+    uint32_t max_pulses; /* Longest train */
+};
+
+int coin_pulse_init(const struct device *port, coin_pulse_coin_t coin_cb);
+uint8_t coin_pulse_pulses(gpio_pin_t pin);
+void coin_pulse_stats_get(struct coin_pulse_stats *out);
+void coin_pulse_report(void);
+
+#endif /* COIN_PULSE_H */
@@ -0,0 +1,186 @@
+/** @file debounce.c
+ * @brief Implementation of the software debounce of the buttons
+ *
+ * The first edge of a pin opens its window and
+ * timestamps the press. Every other edge seen
+ * before the window ends is a bounce: it is
+ * counted and restarts the window. When the
+ * window ends the pin is read, and the press is
+ * delivered only if the pin is still active.
+ *
+ * All the pins share one k_timer, always armed
+ * for the earliest window still open, so the
+ * cost does not grow with the number of pins
+ * and the state machine only sees stable presses.
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#include "debounce.h"
+
+static void debounce_expiry(struct k_timer *timer);
+
+K_TIMER_DEFINE(debounce_timer, debounce_expiry, NULL);
+
+static const struct device *gpio_port; /* Port of the debounced pins */
+static debounce_press_t on_press; /* Receiver of the stable presses */
+static struct k_spinlock lock; /* The GPIO and the timer ISR share the state below */
+static uint32_t settling=0; /* Pins whose window is open */
+static int64_t deadline[32]; /* End of the window of each pin, in ticks */
+static timing_t first_edge[32]; /* Time of the first edge of the press */
+static uint16_t window_ms[32]; /* Window of each pin */
+static struct debounce_stats stats; /* Counters, see debounce_stats_get() */
+
+/**
+ * @brief debounce_arm function start the timer for the next window end
+ *
+ * Must be called with the lock held.
+ *
+ * @param now current time in ticks
+ */
+
+static void debounce_arm(int64_t now){
+    uint32_t pins = settling;
+    int64_t next = INT64_MAX;
+
+    if (pins == 0) {
+        k_timer_stop(&debounce_timer);
+        return;
+    }
+    while (pins) {
+        int pin = find_lsb_set(pins) - 1;
+
+        pins &= pins - 1;
+        next = MIN(next, deadline[pin]);
+    }
+    k_timer_start(&debounce_timer, next > now ? K_TICKS(next - now) : K_NO_WAIT, K_NO_WAIT);
+}
+
+/**
+ * @brief debounce_expiry function close the windows that ended
+ *
+ * Runs in the timer ISR. The presses are
+ * delivered outside the lock, lowest pin first.
+ *
+ * @param timer debounce_timer
+ */
+
+static void debounce_expiry(struct k_timer *timer){
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    int64_t now = k_uptime_ticks();
+    uint32_t pins = settling;
+    uint32_t pressed = 0;
+    timing_t stamps[32];
+
+    while (pins) {
+        int pin = find_lsb_set(pins) - 1;
+
+        pins &= pins - 1;
+        if (deadline[pin] > now) {
+            continue;
+        }
+        settling &= ~BIT(pin);
+        if (gpio_pin_get(gpio_port, pin) > 0) {
+            pressed |= BIT(pin);
+            stamps[pin] = first_edge[pin];
+            stats.presses++;
+        } else {
+            stats.glitches++;
+        }
+    }
+    debounce_arm(now);
+    k_spin_unlock(&lock, key);
+
+    while (pressed) {
+        int pin = find_lsb_set(pressed) - 1;
+
+        pressed &= pressed - 1;
+        on_press(pin, stamps[pin]);
+    }
+}
+
+/**
+ * @brief debounce_init function start the debounce
+ *
+ * @param port GPIO port of the pins
+ * @param press_cb function receiving the stable presses
+ */
+
+void debounce_init(const struct device *port, debounce_press_t press_cb){
+    gpio_port = port;
+    on_press = press_cb;
+    for (int i = 0; i < ARRAY_SIZE(window_ms); i++) {
+        if (window_ms[i] == 0) {
+            window_ms[i] = DEBOUNCE_DEFAULT_MS;
+        }
+    }
+}
+
+/**
+ * @brief debounce_set_window function set the window of a pin
+ *
+ * @param pin pin number
+ * @param ms time the pin must stay stable, in ms
+ */
+
+void debounce_set_window(gpio_pin_t pin, uint16_t ms){
+    window_ms[pin] = MAX(ms, 1);
+}
+
+/**
+ * @brief debounce_window_get function read the window of a pin
+ *
+ * @param pin pin number
+ * @return window in ms
+ */
+
+uint16_t debounce_window_get(gpio_pin_t pin){
+    return window_ms[pin];
+}
+
+/**
+ * @brief debounce_edge function handle the edges of the GPIO ISR
+ *
+ * @param pins mask of the pins that had an edge
+ */
+
+void debounce_edge(gpio_port_pins_t pins){
+    timing_t stamp = timing_counter_get();
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    int64_t now = k_uptime_ticks();
+
+    while (pins) {
+        int pin = find_lsb_set(pins) - 1;
+
+        pins &= pins - 1;
+        stats.edges++;
+        if (settling & BIT(pin)) {
+            stats.bounces++;
+        } else {
+            settling |= BIT(pin);
+            first_edge[pin] = stamp;
+        }
+        deadline[pin] = now + k_ms_to_ticks_ceil32(window_ms[pin]);
+    }
+    debounce_arm(now);
+    k_spin_unlock(&lock, key);
+}
+
+/**
+ * @brief debounce_stats_get function read the debounce counters
+ *
+ * Every edge opens a window or is a
+ * bounce, every window ends as a press
+ * or as a glitch.
+ *
+ * @param out where the counters are copied
+ */
+
+void debounce_stats_get(struct debounce_stats *out){
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    *out = stats;
+    k_spin_unlock(&lock, key);
+}
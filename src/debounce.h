@@ -0,0 +1,36 @@
+/** @file debounce.h
+ * @brief Declarations of the software debounce of the buttons
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#ifndef DEBOUNCE_H
+#define DEBOUNCE_H
+
+#include <zephyr.h>
+#include <device.h>
+#include <drivers/gpio.h>
+#include <timing/timing.h>
+
+#define DEBOUNCE_DEFAULT_MS 10 /* Window of the pins without an explicit one */
+
+/* Called, from the timer ISR, for every stable press */
+typedef void (*debounce_press_t)(gpio_pin_t pin, timing_t first_edge);
+
+/* Counters of the debounce */
+struct debounce_stats {
+    uint32_t edges; /* Edges seen by the GPIO ISR */
+    uint32_t presses; /* Stable presses delivered */
+    uint32_t bounces; /* Edges rejected because the pin was still settling */
+    uint32_t glitches; /* Pulses rejected because the pin was inactive at the end of the window */
+};
+
+void debounce_init(const struct device *port, debounce_press_t press_cb);
+void debounce_set_window(gpio_pin_t pin, uint16_t ms);
+uint16_t debounce_window_get(gpio_pin_t pin);
+void debounce_edge(gpio_port_pins_t pins);
+void debounce_stats_get(struct debounce_stats *stats);
+
+#endif /* DEBOUNCE_H */
@@ -0,0 +1,172 @@
+/** @file dispenser.c
+ * @brief Implementation of the asynchronous dispenser
+ *
+ * A sale only queues a vend job; the state
+ * machine goes back to IDLE at once and keeps
+ * taking coins and selections. The jobs run one
+ * at a time, each through the stages reserve,
+ * actuate and confirm, timed with a delayable
+ * work item on the system workqueue. When the
+ * product has dropped the state machine gets
+ * an event through the done callback. The
+ * callback never blocks the workqueue: if it
+ * cannot post the event the vend stays at the
+ * head of the queue and the completion is tried
+ * again DISPENSER_RETRY_MS later.
+ *
+ * The stage handlers are where the slot lock,
+ * the motor and the drop sensor of the real
+ * cabinet are driven; here only the timing is
+ * modeled.
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#include <zephyr.h>
+#include <sys/printk.h>
+
+#include "dispenser.h"
+
+static void dispenser_stage(struct k_work *work);
+
+K_WORK_DELAYABLE_DEFINE(stage_work, dispenser_stage);
+
+static struct k_spinlock lock; /* Protects the queue and the stage */
+static uint8_t queue[DISPENSER_QUEUE_LEN]; /* Products to vend, oldest at tail */
+static uint8_t tail=0; /* Index of the running or next vend */
+static uint8_t queued=0; /* Vends in the queue */
+static uint8_t stage=DISPENSER_IDLE; /* Stage of the vend at tail */
+static dispenser_done_t done_cb; /* Completion callback */
+static struct dispenser_stats stats; /* Counters, see dispenser_stats_get() */
+
+/**
+ * @brief dispenser_init function set the completion callback
+ *
+ * @param done called with the product when a vend is complete
+ */
+
+void dispenser_init(dispenser_done_t done){
+    done_cb = done;
+}
+
+/**
+ * @brief dispenser_start function start the next vend if the motor is free
+ *
+ * Must be called with lock held.
+ *
+ */
+
+static void dispenser_start(void){
+    if (stage == DISPENSER_IDLE && queued > 0) {
+        stage = DISPENSER_RESERVE;
+        k_work_reschedule(&stage_work, K_MSEC(DISPENSER_RESERVE_MS));
+    }
+}
+
+/**
+ * @brief dispenser_submit function queue the vend of a product
+ *
+ * The product must already be taken from the
+ * catalog and paid.
+ *
+ * @param product product to vend
+ * @return false if the queue is full
+ */
+
+bool dispenser_submit(uint8_t product){
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    if (queued == DISPENSER_QUEUE_LEN) {
+        k_spin_unlock(&lock, key);
+        return false;
+    }
+    queue[(tail + queued) % DISPENSER_QUEUE_LEN] = product;
+    queued++;
+    stats.submitted++;
+    stats.max_queued = MAX(stats.max_queued, queued);
+    dispenser_start();
+    k_spin_unlock(&lock, key);
+    return true;
+}
+
+/**
+ * @brief dispenser_full function tell if a sale can be queued
+ *
+ * @return true if the queue is full
+ */
+
+bool dispenser_full(void){
+    return queued == DISPENSER_QUEUE_LEN;
+}
+
+/**
+ * @brief dispenser_stage function move the running vend to the next stage
+ *
+ * @param work stage_work
+ */
+
+static void dispenser_stage(struct k_work *work){
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    uint8_t product = queue[tail];
+
+    switch (stage) {
+    case DISPENSER_RESERVE:
+        /* Slot unlocked: run the motor */
+        stage = DISPENSER_ACTUATE;
+        k_work_reschedule(&stage_work, K_MSEC(DISPENSER_ACTUATE_MS));
+        k_spin_unlock(&lock, key);
+        return;
+    case DISPENSER_ACTUATE:
+        /* Motor stopped: wait for the drop sensor */
+        stage = DISPENSER_CONFIRM;
+        k_work_reschedule(&stage_work, K_MSEC(DISPENSER_CONFIRM_MS));
+        k_spin_unlock(&lock, key);
+        return;
+    case DISPENSER_CONFIRM:
+        break;
+    default:
+        /* Cancelled by a reschedule that found no vend */
+        k_spin_unlock(&lock, key);
+        return;
+    }
+
+    k_spin_unlock(&lock, key);
+
+    /* Confirmed: the vend is over once the state machine has been told */
+    if (!done_cb(product)) {
+        stats.retries++;
+        k_work_reschedule(&stage_work, K_MSEC(DISPENSER_RETRY_MS));
+        return;
+    }
+
+    key = k_spin_lock(&lock);
+    tail = (tail + 1) % DISPENSER_QUEUE_LEN;
+    queued--;
+    stats.completed++;
+    stage = DISPENSER_IDLE;
+    dispenser_start();
+    k_spin_unlock(&lock, key);
+}
+
+/**
+ * @brief dispenser_stats_get function read the dispenser counters
+ *
+ * @param out where the counters are copied
+ */
+
+void dispenser_stats_get(struct dispenser_stats *out){
+    *out = stats;
+}
+
+/**
+ * @brief dispenser_report function print the dispenser counters
+ *
+ */
+
+void dispenser_report(void){
+    printk("Dispenser: %u queued, %u completed, %u waiting (max %u), stage %u\n",
+           stats.submitted, stats.completed, queued, stats.max_queued, stage);
+    printk("Completions posted again: %u\n", stats.retries);
+}
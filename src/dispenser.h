@@ -0,0 +1,43 @@
+/** @file dispenser.h
+ * @brief Declarations of the asynchronous dispenser
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#ifndef DISPENSER_H
+#define DISPENSER_H
+
+#include <zephyr.h>
+
+#define DISPENSER_QUEUE_LEN 4 /* Sales waiting for the motor, the running one included */
+#define DISPENSER_RESERVE_MS 50 /* Slot unlocked and motor powered */
+#define DISPENSER_ACTUATE_MS 1500 /* One turn of the spiral */
+#define DISPENSER_CONFIRM_MS 300 /* Window of the drop sensor */
+#define DISPENSER_RETRY_MS 10 /* Delay before posting a completion again */
+
+/* Stages of a vend */
+#define DISPENSER_IDLE 0 /* No vend running */
+#define DISPENSER_RESERVE 1
+#define DISPENSER_ACTUATE 2
+#define DISPENSER_CONFIRM 3
+
+/* Called from the system workqueue when a product has dropped, false to be called again */
+typedef bool (*dispenser_done_t)(uint8_t product);
+
+/* Counters of the dispenser */
+struct dispenser_stats {
+    uint32_t submitted; /* Vends queued */
+    uint32_t completed; /* Vends finished */
+    uint32_t retries; /* Completions refused by the done callback and posted again */
+    uint32_t max_queued; /* Most vends waiting at the same time */
+};
+
+void dispenser_init(dispenser_done_t done);
+bool dispenser_submit(uint8_t product);
+bool dispenser_full(void);
+void dispenser_stats_get(struct dispenser_stats *stats);
+void dispenser_report(void);
+
+#endif /* DISPENSER_H */
@@ -0,0 +1,209 @@
+/** @file display.c
+ * @brief Implementation of the change-only display model
+ *
+ * The log records update a model of the screen,
+ * one row per field: product, price, credit,
+ * status and exact change. A frame compares every
+ * row with what the terminal already shows and
+ * sends only the characters that differ, after a
+ * cursor position escape (ESC [ row ; col H);
+ * a row that got shorter is cut with ESC [ K.
+ * The first frame clears the screen.
+ *
+ * The log thread applies the records as they
+ * come and sends a frame at most every
+ * 1000 / CONFIG_APP_DISPLAY_FPS ms, so a burst of
+ * records costs one frame with the final values.
+ *
+ * To compare with the text lines, every record
+ * is also formatted as applog_write() would print
+ * it and its length counted.
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#include <zephyr.h>
+#include <sys/printk.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "catalog.h"
+#include "display.h"
+#include "machine.h"
+#include "uart_tx.h"
+
+#define DISPLAY_FRAME_SIZE 256 /* Worst frame: every row redrawn */
+
+static char model[DISPLAY_ROWS][DISPLAY_COLS + 1]; /* Screen wanted */
+static char shown[DISPLAY_ROWS][DISPLAY_COLS + 1]; /* Screen on the terminal */
+static bool cleared=false; /* The first frame has cleared the screen */
+static bool dirty=false; /* model differs from shown */
+static struct display_stats stats; /* Counters, see display_stats_get() */
+
+/**
+ * @brief display_set function write a field of the model
+ *
+ * @param row field (DISPLAY_xxx)
+ * @param fmt printf format of the field
+ */
+
+static void display_set(int row, const char *fmt, ...){
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintk(model[row], sizeof(model[row]), fmt, ap);
+    va_end(ap);
+    dirty = true;
+}
+
+/**
+ * @brief display_apply function update the model with a log record
+ *
+ * @param rec record queued by the state handlers
+ */
+
+void display_apply(const struct applog_record *rec){
+    char line[96];
+    int credit = rec->credit;
+    const struct product *prod = catalog_lookup(rec->product);
+
+    stats.records++;
+    stats.text_bytes += applog_format(rec, line, sizeof(line));
+
+    switch (rec->id) {
+    case APPLOG_PRODUCT:
+        display_set(DISPLAY_PRODUCT, "%s", prod->name);
+        display_set(DISPLAY_PRICE, "Price: %d.%02d EUR", prod->price/100, prod->price%100);
+        display_set(DISPLAY_CREDIT, "Credit: %d.%02d EUR", credit/100, credit%100);
+        break;
+    case APPLOG_CREDIT:
+        display_set(DISPLAY_CREDIT, "Credit: %d.%02d EUR", credit/100, credit%100);
+        break;
+    case APPLOG_RETURN:
+        display_set(DISPLAY_STATUS, "%d.%02d EUR returned", credit/100, credit%100);
+        display_set(DISPLAY_CREDIT, "Credit: 0.00 EUR");
+        break;
+    case APPLOG_SOLD_OUT:
+        display_set(DISPLAY_STATUS, "%s sold out", prod->name);
+        break;
+    case APPLOG_NO_CREDIT:
+        display_set(DISPLAY_STATUS, "Not enough credit");
+        break;
+    case APPLOG_DISPENSED:
+        display_set(DISPLAY_STATUS, "%s dispensed", prod->name);
+        display_set(DISPLAY_CREDIT, "Credit: %d.%02d EUR", credit/100, credit%100);
+        break;
+    case APPLOG_CHANGE:
+        display_set(DISPLAY_STATUS, "%d.%02d EUR change", credit/100, credit%100);
+        break;
+    case APPLOG_EXACT_CHANGE:
+        display_set(DISPLAY_CHANGE, "%s", credit ? "Exact change only" : "");
+        break;
+    case APPLOG_BUSY:
+        display_set(DISPLAY_STATUS, "Dispenser busy");
+        break;
+    case APPLOG_STATE:
+        display_set(DISPLAY_STATUS, "State %s", machine_state_name(rec->product));
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief display_dirty function tell if a frame has something to send
+ *
+ * @return true if the model differs from the terminal
+ */
+
+bool display_dirty(void){
+    return dirty;
+}
+
+/**
+ * @brief display_flush function send the changed characters of every row
+ *
+ * @return number of bytes sent
+ */
+
+int display_flush(void){
+    char frame[DISPLAY_FRAME_SIZE];
+    int len = 0;
+
+    if (!cleared) {
+        len += snprintk(frame, sizeof(frame), "\x1b[2J");
+        cleared = true;
+    }
+
+    for (int row = 0; row < DISPLAY_ROWS; row++) {
+        const char *new = model[row];
+        char *old = shown[row];
+        int new_len = strlen(new);
+        int old_len = strlen(old);
+        int first = 0;
+        int last;
+
+        while (first < new_len && new[first] == old[first]) {
+            first++;
+        }
+        if (first == new_len && new_len == old_len) {
+            continue;
+        }
+        last = new_len - 1;
+        /* ESC [ K of a shorter row erases the tail too, so it is sent again */
+        while (new_len == old_len && last >= first && new[last] == old[last]) {
+            last--;
+        }
+
+        len += snprintk(frame + len, sizeof(frame) - len, "\x1b[%d;%dH", row + 1, first + 1);
+        memcpy(frame + len, new + first, last - first + 1);
+        len += last - first + 1;
+        if (new_len < old_len) {
+            memcpy(frame + len, "\x1b[K", 3);
+            len += 3;
+        }
+        strcpy(old, new);
+        stats.fields++;
+    }
+    dirty = false;
+    frame[len] = '\0';
+
+    if (len == 0) {
+        return 0;
+    }
+#ifdef CONFIG_APP_UART_TX_ASYNC
+    uart_tx_write(frame, len);
+#else
+    printk("%s", frame);
+#endif
+    stats.frames++;
+    stats.bytes += len;
+    return len;
+}
+
+/**
+ * @brief display_stats_get function read the display counters
+ *
+ * @param out where the counters are copied
+ */
+
+void display_stats_get(struct display_stats *out){
+    *out = stats;
+}
+
+/**
+ * @brief display_report function compare the bytes sent with the text lines
+ *
+ */
+
+void display_report(void){
+    uint32_t records = MAX(stats.records, 1);
+
+    printk("Display: %u records in %u frames, %u fields sent\n", stats.records, stats.frames,
+           stats.fields);
+    printk("Bytes: %u sent, %u as text lines (%u%%), %u vs %u per record\n", stats.bytes,
+           stats.text_bytes, (uint32_t)(100ULL * stats.bytes / MAX(stats.text_bytes, 1)),
+           stats.bytes / records, stats.text_bytes / records);
+}
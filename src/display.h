@@ -0,0 +1,41 @@
+/** @file display.h
+ * @brief Declarations of the change-only display model
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include <zephyr.h>
+
+#include "applog.h"
+
+#define DISPLAY_COLS 32 /* Characters of a row */
+
+/* Rows of the screen, each one a field */
+#define DISPLAY_PRODUCT 0 /* Name of the selected product */
+#define DISPLAY_PRICE 1 /* "Price: <price> EUR" */
+#define DISPLAY_CREDIT 2 /* "Credit: <credit> EUR" */
+#define DISPLAY_STATUS 3 /* Last event: dispensed, sold out, change ... */
+#define DISPLAY_CHANGE 4 /* "Exact change only" or empty */
+#define DISPLAY_ROWS 5
+
+/* Counters of the display */
+struct display_stats {
+    uint32_t records; /* Log records applied to the model */
+    uint32_t frames; /* Frames sent */
+    uint32_t fields; /* Fields sent */
+    uint32_t bytes; /* Bytes sent, escape sequences included */
+    uint32_t text_bytes; /* Bytes the same records take as text lines */
+};
+
+void display_apply(const struct applog_record *rec);
+bool display_dirty(void);
+int display_flush(void);
+void display_stats_get(struct display_stats *stats);
+void display_report(void);
+
+#endif /* DISPLAY_H */
@@ -0,0 +1,196 @@
+/** @file fsm.c
+ * @brief Implementation of the table-driven state machine engine
+ *
+ * An event is looked up in the row of the current
+ * state, then in the rows of its parents. The
+ * transition exits the states up to the common
+ * ancestor of source and target and enters the
+ * states down to the target. The event returned
+ * by the entry action of the target, if any, is
+ * dispatched in the same call (run to completion).
+ * Since the nesting is limited to FSM_MAX_DEPTH,
+ * the cost of a transition is bounded.
+ *
+ * The dispatch only keeps the raw cycles of
+ * its transitions; the conversion to ns and the
+ * division by the transitions are left to
+ * fsm_timing_get(), out of the dispatch path.
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#include "fsm.h"
+
+/**
+ * @brief fsm_lookup function find the target of an event
+ *
+ * @param fsm machine
+ * @param event event to look up
+ * @return target state, FSM_NONE if no state handles the event
+ */
+
+static uint8_t fsm_lookup(const struct fsm *fsm, uint8_t event){
+    const struct fsm_desc *desc = fsm->desc;
+    uint8_t s = fsm->current;
+
+    for (int depth = 0; depth < FSM_MAX_DEPTH && s != FSM_NONE; depth++) {
+        uint8_t to = desc->table[s * desc->n_events + event];
+
+        if (to != 0) {
+            return to - 1;
+        }
+        s = desc->states[s].parent;
+    }
+    return FSM_NONE;
+}
+
+/**
+ * @brief fsm_is_ancestor function check the nesting of two states
+ *
+ * @param states states of the machine
+ * @param anc candidate ancestor
+ * @param s state
+ * @return true if anc is s or one of its parents
+ */
+
+static bool fsm_is_ancestor(const struct fsm_state *states, uint8_t anc, uint8_t s){
+    for (int depth = 0; depth < FSM_MAX_DEPTH && s != FSM_NONE; depth++) {
+        if (s == anc) {
+            return true;
+        }
+        s = states[s].parent;
+    }
+    return false;
+}
+
+/**
+ * @brief fsm_transition function move the machine to a new state
+ *
+ * Exit actions run from the current state up,
+ * entry actions from the top down to the target.
+ * A transition to the state itself or to one of
+ * its parents exits and enters that state again.
+ *
+ * @param fsm machine
+ * @param next target state
+ * @return event posted by the entry actions, or FSM_NO_EVENT
+ */
+
+static uint8_t fsm_transition(struct fsm *fsm, uint8_t next){
+    const struct fsm_state *states = fsm->desc->states;
+    uint8_t path[FSM_MAX_DEPTH]; /* States to enter, target first */
+    uint8_t event = FSM_NO_EVENT;
+    uint8_t lca = fsm->current;
+    int n = 0;
+
+    /* Least common ancestor, excluding the target itself */
+    while (lca != FSM_NONE && (lca == next || !fsm_is_ancestor(states, lca, next))) {
+        lca = states[lca].parent;
+    }
+
+    for (uint8_t s = fsm->current; s != lca; s = states[s].parent) {
+        if (states[s].exit != NULL) {
+            states[s].exit(fsm);
+        }
+    }
+
+    for (uint8_t s = next; s != lca && n < FSM_MAX_DEPTH; s = states[s].parent) {
+        path[n++] = s;
+    }
+    fsm->current = next;
+    while (n-- > 0) {
+        if (states[path[n]].entry != NULL) {
+            uint8_t posted = states[path[n]].entry(fsm);
+
+            if (posted != FSM_NO_EVENT) {
+                event = posted;
+            }
+        }
+    }
+    return event;
+}
+
+/**
+ * @brief fsm_init function start a machine
+ *
+ * The initial state is set without running
+ * its entry action.
+ *
+ * @param fsm machine
+ * @param desc const description of the machine
+ * @param initial initial state
+ */
+
+void fsm_init(struct fsm *fsm, const struct fsm_desc *desc, uint8_t initial){
+    fsm->desc = desc;
+    fsm->current = initial;
+    fsm->transitions = 0;
+    fsm->timed = true;
+    fsm->last_taken = 0;
+    fsm->max_taken = 0;
+    fsm->last_cycles = 0;
+    fsm->max_cycles = 0;
+}
+
+/**
+ * @brief fsm_dispatch function run an event through the machine
+ *
+ * fsm_dispatch takes the transition of the
+ * event, then keeps dispatching the events
+ * posted by the entry actions until the
+ * machine settles. Unless timed is cleared,
+ * the cycles spent are stored in the machine.
+ *
+ * @param fsm machine
+ * @param event event to dispatch
+ * @return false if the event is not handled in the current state
+ */
+
+bool fsm_dispatch(struct fsm *fsm, uint8_t event){
+    timing_t start = fsm->timed ? timing_counter_get() : 0;
+    timing_t end;
+    uint32_t taken = 0;
+    uint8_t next;
+
+    while (event != FSM_NO_EVENT) {
+        __ASSERT_NO_MSG(event < fsm->desc->n_events);
+        next = fsm_lookup(fsm, event);
+        if (next == FSM_NONE) {
+            break;
+        }
+        event = fsm_transition(fsm, next);
+        taken++;
+    }
+
+    if (taken == 0) {
+        return false;
+    }
+    fsm->transitions += taken;
+    if (fsm->timed) {
+        end = timing_counter_get();
+        fsm->last_cycles = (uint32_t)timing_cycles_get(&start, &end);
+        fsm->last_taken = (uint8_t)MIN(taken, UINT8_MAX);
+        /* Per transition, without a division: last / taken > max / max_taken */
+        if ((uint64_t)fsm->last_cycles * fsm->max_taken >=
+            (uint64_t)fsm->max_cycles * fsm->last_taken) {
+            fsm->max_cycles = fsm->last_cycles;
+            fsm->max_taken = fsm->last_taken;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief fsm_timing_get function read the duration of the transitions
+ *
+ * @param fsm machine
+ * @param last_ns duration per transition of the last fsm_dispatch()
+ * @param max_ns worst duration per transition
+ */
+
+void fsm_timing_get(const struct fsm *fsm, uint32_t *last_ns, uint32_t *max_ns){
+    *last_ns = (uint32_t)(timing_cycles_to_ns(fsm->last_cycles) / MAX(fsm->last_taken, 1));
+    *max_ns = (uint32_t)(timing_cycles_to_ns(fsm->max_cycles) / MAX(fsm->max_taken, 1));
+}
@@ -0,0 +1,70 @@
+/** @file fsm.h
+ * @brief Declarations of the table-driven state machine engine
+ *
+ * A machine is described by const data only:
+ * an array of states, each with optional entry
+ * and exit actions and a parent state, and a
+ * transition table indexed by state and event.
+ * Both live in flash. The actions get the
+ * running instance, so the machine that owns it
+ * is found with CONTAINER_OF and one description
+ * can drive many instances.
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#ifndef FSM_H
+#define FSM_H
+
+#include <zephyr.h>
+#include <timing/timing.h>
+
+#define FSM_NONE 0xFF /* No state (parent of a top level state) */
+#define FSM_NO_EVENT 0xFF /* Returned by an entry action that does not post an event */
+#define FSM_MAX_DEPTH 4 /* Maximum nesting of states */
+
+/* Transition table entry, 0 means the event is not handled by the state */
+#define FSM_TO(s) ((s) + 1)
+
+struct fsm;
+
+/* Entry action, can return an event that is dispatched right after it */
+typedef uint8_t (*fsm_entry_t)(struct fsm *fsm);
+/* Exit action */
+typedef void (*fsm_exit_t)(struct fsm *fsm);
+
+/* State of a machine */
+struct fsm_state {
+    const char *name; /* Name of the state, for debug */
+    uint8_t parent; /* Parent state, FSM_NONE for a top level state */
+    fsm_entry_t entry; /* Run when the state is entered, can be NULL */
+    fsm_exit_t exit; /* Run when the state is left, can be NULL */
+};
+
+/* Const description of a machine */
+struct fsm_desc {
+    const struct fsm_state *states; /* States, indexed by state id */
+    const uint8_t *table; /* n_states x n_events entries, FSM_TO(next) or 0 */
+    uint8_t n_states; /* Number of states */
+    uint8_t n_events; /* Number of events */
+};
+
+/* Running instance of a machine */
+struct fsm {
+    const struct fsm_desc *desc; /* Description of the machine */
+    uint8_t current; /* Current (leaf) state */
+    uint32_t transitions; /* Number of transitions taken */
+    bool timed; /* fsm_dispatch() measures itself, see fsm_timing_get() */
+    uint8_t last_taken; /* Transitions of the last timed fsm_dispatch() */
+    uint8_t max_taken; /* Transitions of the worst one */
+    uint32_t last_cycles; /* Duration of the last timed fsm_dispatch() */
+    uint32_t max_cycles; /* Duration of the worst one, per transition */
+};
+
+void fsm_init(struct fsm *fsm, const struct fsm_desc *desc, uint8_t initial);
+bool fsm_dispatch(struct fsm *fsm, uint8_t event);
+void fsm_timing_get(const struct fsm *fsm, uint32_t *last_ns, uint32_t *max_ns);
+
+#endif /* FSM_H */
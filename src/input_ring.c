@@ -0,0 +1,93 @@
+/** @file input_ring.c
+ * @brief Implementation of the ISR to thread input ring buffer
+ *
+ * Lock-free single producer, single consumer ring.
+ * The producers are the debounce timer and the
+ * poll timer of coin_pulse.c; both are k_timer
+ * expiry functions, run one after the other by
+ * the system clock interrupt, so they never
+ * overlap and count as a single producer (the
+ * load generator puts with the interrupts
+ * locked, for the same reason). The consumer is
+ * the input thread. The head index is only
+ * written by the producer and the tail index only
+ * by the consumer, so no lock is needed.
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#include "input_ring.h"
+
+BUILD_ASSERT((INPUT_RING_SIZE & (INPUT_RING_SIZE - 1)) == 0, "INPUT_RING_SIZE must be a power of two");
+
+static struct input_event ring[INPUT_RING_SIZE]; /* Event storage */
+static atomic_t head = ATOMIC_INIT(0); /* Free running write index, owned by the producer */
+static atomic_t tail = ATOMIC_INIT(0); /* Free running read index, owned by the consumer */
+static uint32_t overflows=0; /* Events dropped because the ring was full */
+
+/**
+ * @brief input_ring_put function store an event in the ring
+ *
+ * input_ring_put is called by the producer (ISR).
+ * It publishes the event by advancing the head
+ * index. If the ring is full the event is
+ * dropped and counted.
+ *
+ * @param pin pin that generated the event
+ * @param timestamp time of the press
+ * @return true if the event was stored
+ */
+
+bool input_ring_put(uint8_t pin, timing_t timestamp){
+    atomic_val_t h = atomic_get(&head);
+
+    if ((uint32_t)(h - atomic_get(&tail)) >= INPUT_RING_SIZE) {
+        overflows++;
+        return false;
+    }
+    ring[h & (INPUT_RING_SIZE - 1)].timestamp = timestamp;
+    ring[h & (INPUT_RING_SIZE - 1)].pin = pin;
+    /* atomic_set orders the event write before the index update */
+    atomic_set(&head, h + 1);
+    return true;
+}
+
+/**
+ * @brief input_ring_get function take the oldest event from the ring
+ *
+ * input_ring_get is called by the consumer
+ * (input thread). Events are returned
+ * in the same order they were stored.
+ *
+ * @param ev where the event is copied
+ * @return true if an event was available
+ */
+
+bool input_ring_get(struct input_event *ev){
+    atomic_val_t t = atomic_get(&tail);
+
+    if (t == atomic_get(&head)) {
+        return false;
+    }
+    *ev = ring[t & (INPUT_RING_SIZE - 1)];
+    atomic_set(&tail, t + 1);
+    return true;
+}
+
+/**
+ * @brief input_ring_stats_get function read the ring counters
+ *
+ * Every event is either popped, still in the ring
+ * or counted as overflow, so pushed - popped is the
+ * number of events waiting to be handled.
+ *
+ * @param stats where the counters are copied
+ */
+
+void input_ring_stats_get(struct input_ring_stats *stats){
+    stats->pushed = (uint32_t)atomic_get(&head);
+    stats->popped = (uint32_t)atomic_get(&tail);
+    stats->overflows = overflows;
+}
@@ -0,0 +1,40 @@
+/** @file input_ring.h
+ * @brief Declarations of the ISR to thread input ring buffer
+ *
+ * Every button press is stored as an event with
+ * its source pin and a timestamp taken with the
+ * timing API, so that no input is lost or merged
+ * with another one before the state machine
+ * handles it.
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#ifndef INPUT_RING_H
+#define INPUT_RING_H
+
+#include <zephyr.h>
+#include <timing/timing.h>
+
+#define INPUT_RING_SIZE 64 /* Number of events, must be a power of two */
+
+/* Input event written by the ISR */
+struct input_event {
+    timing_t timestamp; /* Time of the first edge of the press, from timing_counter_get() */
+    uint8_t pin; /* Pin that generated the event (BOARDBUTx) */
+};
+
+/* Counters of the input ring */
+struct input_ring_stats {
+    uint32_t pushed; /* Events stored by the producer */
+    uint32_t popped; /* Events taken by the consumer */
+    uint32_t overflows; /* Events dropped because the ring was full */
+};
+
+bool input_ring_put(uint8_t pin, timing_t timestamp);
+bool input_ring_get(struct input_event *ev);
+void input_ring_stats_get(struct input_ring_stats *stats);
+
+#endif /* INPUT_RING_H */
@@ -0,0 +1,495 @@
+/** @file journal.c
+ * @brief Implementation of the transaction journal
+ *
+ * Every coin, sale, refused sale and refund is
+ * appended as a CRC'd record to the sectors of
+ * the storage partition that follow NVS, used
+ * as a ring. The NVS state of persist.c is the
+ * snapshot: it holds the sequence number of the
+ * last record it includes, so at boot only the
+ * newer records are replayed.
+ *
+ * An append only numbers the record and copies
+ * it into a RAM ring of JOURNAL_RING_LEN
+ * records; the state machine never touches the
+ * flash. The ring is flushed by persist_work_q,
+ * the queue that also writes the snapshot, so
+ * journal and NVS never compete for the flash,
+ * and as it runs below every other thread a
+ * burst of records goes out in one write. When
+ * a sector is started, the next one, holding
+ * the oldest records, is compacted in the same
+ * queue: the snapshot is written first, then
+ * the sector is erased. If the snapshot or the
+ * erase fails the sector is kept and the
+ * compaction tried again later.
+ *
+ * A failed write keeps its records in the ring,
+ * to be written again in the next slots after
+ * PERSIST_RETRY_MS; the boot scan skips the
+ * copies it already replayed. A record that
+ * finds the ring full is dropped, the snapshot
+ * still holds the change. Both are counted.
+ *
+ * A missing record stops the replay: the
+ * records after it are counted as lost and
+ * journal_init() reports a failed restore. The
+ * sequence numbers still go on after the newest
+ * record found, so a record on flash is never
+ * numbered twice.
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#include <zephyr.h>
+#include <device.h>
+#include <devicetree.h>
+#include <drivers/flash.h>
+#include <storage/flash_map.h>
+#include <sys/atomic.h>
+#include <sys/crc.h>
+#include <sys/printk.h>
+#include <timing/timing.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "journal.h"
+#include "persist.h"
+
+#define JOURNAL_RECORD_SIZE sizeof(struct journal_record)
+#define JOURNAL_CRC_LEN offsetof(struct journal_record, crc)
+
+static void journal_compact(struct k_work *work);
+static void journal_flush(struct k_work *work);
+
+K_WORK_DELAYABLE_DEFINE(compact_work, journal_compact);
+K_WORK_DELAYABLE_DEFINE(flush_work, journal_flush);
+
+static const struct device *flash_dev; /* Flash holding the storage partition */
+static off_t base; /* Offset of the first journal sector */
+static size_t sector_size; /* Size of a sector */
+static int n_sectors; /* Sectors of the journal */
+static bool ready=false; /* Journal usable */
+static int cur_sector; /* Sector being written */
+static size_t write_off; /* Next free slot in cur_sector */
+static struct k_spinlock lock; /* Protects the ring indexes and last_seq */
+static struct journal_record ring[JOURNAL_RING_LEN]; /* Records not yet on flash */
+static uint32_t ring_head; /* Free running index of the next record staged */
+static uint32_t ring_tail; /* Free running index of the next record to write */
+static uint32_t last_seq; /* Sequence number of the last record staged */
+static uint32_t applied_seq; /* Last record of the restored state */
+static bool gap=false; /* A record is missing, the replay stopped */
+static atomic_t erased=ATOMIC_INIT(0); /* Bit n set if sector n is erased */
+static int compact_sector; /* Sector erased by journal_compact() */
+static struct journal_stats stats; /* Counters, see journal_stats_get() */
+
+/**
+ * @brief sector_offset function return the flash offset of a sector
+ *
+ * @param sector journal sector
+ * @return offset in flash
+ */
+
+static off_t sector_offset(int sector){
+    return base + (off_t)sector * sector_size;
+}
+
+/**
+ * @brief record_empty function tell if a slot was never written
+ *
+ * @param rec slot read from flash
+ * @return true if every byte is erased
+ */
+
+static bool record_empty(const struct journal_record *rec){
+    const uint8_t *p = (const uint8_t *)rec;
+
+    for (size_t i = 0; i < JOURNAL_RECORD_SIZE; i++) {
+        if (p[i] != 0xFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief record_valid function check the CRC of a record
+ *
+ * @param rec record read from flash
+ * @return true if the record is intact
+ */
+
+static bool record_valid(const struct journal_record *rec){
+    return rec->crc == crc32_ieee((const uint8_t *)rec, JOURNAL_CRC_LEN);
+}
+
+/**
+ * @brief scan_sector function walk the records of a sector
+ *
+ * @param sector journal sector
+ * @param snapshot_seq records up to this one are not replayed
+ * @param replay handler of the newer records, NULL to only count
+ * @return offset of the first free slot
+ */
+
+static size_t scan_sector(int sector, uint32_t snapshot_seq, journal_replay_t replay){
+    struct journal_record rec;
+    size_t off;
+
+    for (off = 0; off + JOURNAL_RECORD_SIZE <= sector_size; off += JOURNAL_RECORD_SIZE) {
+        if (flash_read(flash_dev, sector_offset(sector) + off, &rec, sizeof(rec)) != 0 ||
+            record_empty(&rec)) {
+            break;
+        }
+        if (!record_valid(&rec)) {
+            /* Torn write, the slot cannot be reused until the erase */
+            stats.corrupt++;
+            continue;
+        }
+        stats.scanned++;
+        last_seq = MAX(last_seq, rec.seq);
+        /* Older than the snapshot, or the copy of a record written again */
+        if (replay == NULL || rec.seq <= applied_seq) {
+            continue;
+        }
+        if (!gap && rec.seq != applied_seq + 1) {
+            /* Records missing, replaying further would corrupt the state */
+            gap = true;
+        }
+        if (gap) {
+            stats.lost++;
+            continue;
+        }
+        replay(&rec);
+        applied_seq = rec.seq;
+        stats.replayed++;
+    }
+    return off;
+}
+
+/**
+ * @brief journal_init function find the journal and replay its tail
+ *
+ * @param snapshot_seq last record included in the restored snapshot
+ * @param replay called for every newer record, oldest first
+ * @return 0 on success, -EILSEQ if records are missing and the newer
+ *         ones were not replayed, negative error code otherwise
+ */
+
+int journal_init(uint32_t snapshot_seq, journal_replay_t replay){
+    const struct flash_area *fa;
+    struct flash_pages_info info;
+    uint32_t first_seq[JOURNAL_MAX_SECTORS];
+    struct journal_record rec;
+    timing_t start = timing_counter_get();
+    timing_t end;
+    int rc;
+
+    rc = flash_area_open(FLASH_AREA_ID(storage), &fa);
+    if (rc) {
+        return rc;
+    }
+    flash_dev = device_get_binding(fa->fa_dev_name);
+    if (flash_dev == NULL) {
+        return -ENODEV;
+    }
+    rc = flash_get_page_info_by_offs(flash_dev, fa->fa_off, &info);
+    if (rc) {
+        return rc;
+    }
+    sector_size = info.size;
+    base = fa->fa_off + PERSIST_SECTORS * sector_size;
+    n_sectors = MIN((int)(fa->fa_size / sector_size) - PERSIST_SECTORS, JOURNAL_MAX_SECTORS);
+    flash_area_close(fa);
+    if (n_sectors < 2) {
+        return -ENOSPC;
+    }
+
+    /* The sector with the newest first record is the one being written */
+    cur_sector = 0;
+    for (int s = 0; s < n_sectors; s++) {
+        rc = flash_read(flash_dev, sector_offset(s), &rec, sizeof(rec));
+        if (rc) {
+            return rc;
+        }
+        first_seq[s] = record_empty(&rec) || !record_valid(&rec) ? 0 : rec.seq;
+        if (record_empty(&rec)) {
+            atomic_set_bit(&erased, s);
+        }
+        if (first_seq[s] > first_seq[cur_sector]) {
+            cur_sector = s;
+        }
+    }
+
+    /* Oldest sector first */
+    last_seq = snapshot_seq;
+    applied_seq = snapshot_seq;
+    for (int i = 1; i <= n_sectors; i++) {
+        int s = (cur_sector + i) % n_sectors;
+        size_t off = scan_sector(s, snapshot_seq, replay);
+
+        if (s == cur_sector) {
+            write_off = off;
+        }
+    }
+    atomic_clear_bit(&erased, cur_sector);
+    ready = true;
+
+    end = timing_counter_get();
+    stats.replay_us = (uint32_t)(timing_cycles_to_ns(timing_cycles_get(&start, &end)) / 1000);
+
+    compact_sector = (cur_sector + 1) % n_sectors;
+    if (!atomic_test_bit(&erased, compact_sector)) {
+        k_work_reschedule_for_queue(&persist_work_q, &compact_work, K_NO_WAIT);
+    }
+    return gap ? -EILSEQ : 0;
+}
+
+/**
+ * @brief journal_erase function free a sector
+ *
+ * Runs in persist_work_q. The sector is erased
+ * only once the snapshot is on flash, so that
+ * the records lost are all included in it.
+ *
+ * @param sector journal sector
+ * @return 0 on success, negative error code otherwise
+ */
+
+static int journal_erase(int sector){
+    int rc;
+
+    if (atomic_test_bit(&erased, sector)) {
+        return 0;
+    }
+    rc = persist_sync();
+    if (rc == 0) {
+        rc = flash_erase(flash_dev, sector_offset(sector), sector_size);
+    }
+    if (rc) {
+        stats.compact_errors++;
+        return rc;
+    }
+    atomic_set_bit(&erased, sector);
+    stats.compactions++;
+    return 0;
+}
+
+/**
+ * @brief journal_compact function free the oldest sector ahead of the writes
+ *
+ * Runs in persist_work_q; a failure is tried
+ * again after PERSIST_RETRY_MS.
+ *
+ * @param work compact_work
+ */
+
+static void journal_compact(struct k_work *work){
+    if (journal_erase(compact_sector) != 0) {
+        k_work_reschedule_for_queue(&persist_work_q, &compact_work, K_MSEC(PERSIST_RETRY_MS));
+    }
+}
+
+/**
+ * @brief journal_next_sector function move the writes to the next sector
+ *
+ * The next sector is normally erased already;
+ * otherwise the flush compacts it first.
+ *
+ * @return 0 on success, negative error code if the next sector cannot be erased
+ */
+
+static int journal_next_sector(void){
+    int next = (cur_sector + 1) % n_sectors;
+    int rc;
+
+    if (!atomic_test_bit(&erased, next)) {
+        stats.stalls++;
+        rc = journal_erase(next);
+        if (rc) {
+            return rc;
+        }
+    }
+    atomic_clear_bit(&erased, next);
+    cur_sector = next;
+    write_off = 0;
+
+    compact_sector = (next + 1) % n_sectors;
+    k_work_reschedule_for_queue(&persist_work_q, &compact_work, K_NO_WAIT);
+    return 0;
+}
+
+/**
+ * @brief journal_flush function write the staged records to flash
+ *
+ * Runs in persist_work_q. The records are
+ * written in runs, as many as are contiguous
+ * in the ring and fit in the sector. On a
+ * failure the records stay staged and the flush
+ * is tried again after PERSIST_RETRY_MS.
+ *
+ * @param work flush_work
+ */
+
+static void journal_flush(struct k_work *work){
+    while (1) {
+        k_spinlock_key_t key = k_spin_lock(&lock);
+        uint32_t tail = ring_tail;
+        uint32_t n = ring_head - tail;
+        timing_t start;
+        timing_t end;
+        uint32_t us;
+        int rc;
+
+        k_spin_unlock(&lock, key);
+        if (n == 0) {
+            return;
+        }
+        if (write_off + JOURNAL_RECORD_SIZE > sector_size) {
+            rc = journal_next_sector();
+            if (rc) {
+                stats.write_errors++;
+                stats.last_error = rc;
+                k_work_reschedule_for_queue(&persist_work_q, &flush_work, K_MSEC(PERSIST_RETRY_MS));
+                return;
+            }
+        }
+        /* The slots from tail to head are only written by this queue until freed */
+        n = MIN(n, JOURNAL_RING_LEN - tail % JOURNAL_RING_LEN);
+        n = MIN(n, (sector_size - write_off) / JOURNAL_RECORD_SIZE);
+
+        start = timing_counter_get();
+        rc = flash_write(flash_dev, sector_offset(cur_sector) + write_off,
+                         &ring[tail % JOURNAL_RING_LEN], n * JOURNAL_RECORD_SIZE);
+        end = timing_counter_get();
+
+        /* A failed write may have left torn slots, never write them again */
+        write_off += n * JOURNAL_RECORD_SIZE;
+        if (rc) {
+            stats.write_errors++;
+            stats.last_error = rc;
+            k_work_reschedule_for_queue(&persist_work_q, &flush_work, K_MSEC(PERSIST_RETRY_MS));
+            return;
+        }
+
+        key = k_spin_lock(&lock);
+        ring_tail = tail + n;
+        k_spin_unlock(&lock, key);
+
+        us = (uint32_t)(timing_cycles_to_ns(timing_cycles_get(&start, &end)) / 1000);
+        stats.appends += n;
+        stats.writes++;
+        stats.append_us += us;
+        stats.max_append_us = MAX(stats.max_append_us, us);
+    }
+}
+
+/**
+ * @brief journal_append function stage a record
+ *
+ * Cheap: the record is copied in RAM and the
+ * flush is scheduled, nothing is written here.
+ *
+ * @param type JOURNAL_COIN_IN ... JOURNAL_VENDED
+ * @param product selected product
+ * @param amount cents of the event
+ * @param credit credit after the event
+ * @param coins coins paid, NULL if none
+ * @return 0 on success, -ENOBUFS if the ring is full, -ENODEV if the journal is not usable
+ */
+
+int journal_append(uint8_t type, int16_t product, int amount, int32_t credit,
+                   const struct change_coins *coins){
+    struct journal_record *rec;
+    k_spinlock_key_t key;
+
+    if (!ready) {
+        stats.dropped++;
+        return -ENODEV;
+    }
+    key = k_spin_lock(&lock);
+    if (ring_head - ring_tail >= JOURNAL_RING_LEN) {
+        stats.dropped++;
+        k_spin_unlock(&lock, key);
+        return -ENOBUFS;
+    }
+    rec = &ring[ring_head % JOURNAL_RING_LEN];
+    memset(rec, 0, sizeof(*rec));
+    rec->seq = ++last_seq;
+    rec->type = type;
+    rec->product = (uint8_t)product;
+    rec->amount = (uint16_t)amount;
+    rec->credit = credit;
+    if (coins != NULL) {
+        rec->coins = *coins;
+    }
+    rec->crc = crc32_ieee((const uint8_t *)rec, JOURNAL_CRC_LEN);
+    ring_head++;
+    stats.staged++;
+    k_spin_unlock(&lock, key);
+
+    /* A flush waiting to retry keeps its delay */
+    k_work_schedule_for_queue(&persist_work_q, &flush_work, K_NO_WAIT);
+    return 0;
+}
+
+/**
+ * @brief journal_last_seq function return the last record staged
+ *
+ * The snapshot taken now includes the change
+ * of that record, written or not.
+ *
+ * @return sequence number, to be stored in the snapshot
+ */
+
+uint32_t journal_last_seq(void){
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    uint32_t seq = last_seq;
+
+    k_spin_unlock(&lock, key);
+    return seq;
+}
+
+/**
+ * @brief journal_stats_get function read the journal counters
+ *
+ * @param out where the counters are copied
+ */
+
+void journal_stats_get(struct journal_stats *out){
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    *out = stats;
+    out->pending = ring_head - ring_tail;
+    k_spin_unlock(&lock, key);
+}
+
+/**
+ * @brief journal_report function print the journal counters
+ *
+ * The write rate is the one the flash allows,
+ * computed from the time spent in flash_write().
+ *
+ */
+
+void journal_report(void){
+    struct journal_stats now;
+
+    journal_stats_get(&now);
+    printk("Journal: %d sectors of %u records, %u records staged, %u written, %u pending, last seq %u\n",
+           n_sectors, (uint32_t)(sector_size / JOURNAL_RECORD_SIZE), now.staged, now.appends,
+           now.pending, journal_last_seq());
+    printk("Flush: %u writes, %u records/s, max %u us, %u compactions, %u waited for an erase\n",
+           now.writes, (uint32_t)((uint64_t)now.appends * 1000000 / MAX(now.append_us, 1)),
+           now.max_append_us, now.compactions, now.stalls);
+    printk("Errors: %u records dropped (ring full), %u failed writes (last %d), %u compactions retried\n",
+           now.dropped, now.write_errors, now.last_error, now.compact_errors);
+    printk("Boot: %u records scanned, %u replayed, %u corrupt, %u us\n",
+           now.scanned, now.replayed, now.corrupt, now.replay_us);
+    if (gap) {
+        printk("Restore failed: records after %u not replayed, %u lost\n", applied_seq,
+               now.lost);
+    }
+}
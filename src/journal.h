@@ -0,0 +1,68 @@
+/** @file journal.h
+ * @brief Declarations of the transaction journal
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <zephyr.h>
+
+#include "change.h"
+
+#define JOURNAL_MAX_SECTORS 8 /* Sectors of the storage partition used at most */
+#define JOURNAL_RING_LEN 32 /* Records staged in RAM, waiting for the flush */
+
+/* Record types */
+#define JOURNAL_COIN_IN 1 /* Coin accepted, amount is its value */
+#define JOURNAL_VEND 2 /* Product dispensed, amount is its price */
+#define JOURNAL_VEND_FAILED 3 /* Product refused, see the ERROR state */
+#define JOURNAL_REFUND 4 /* Coins paid back, amount is their value */
+#define JOURNAL_VENDED 5 /* Product of a JOURNAL_VEND dropped by the dispenser */
+
+/* One record, written as is to flash */
+struct journal_record {
+    uint32_t seq; /* Sequence number, 1 for the first record ever */
+    uint8_t type; /* JOURNAL_COIN_IN ... JOURNAL_VENDED */
+    uint8_t product; /* Selected product */
+    uint16_t amount; /* Cents */
+    int32_t credit; /* Credit after the event */
+    struct change_coins coins; /* Coins paid, JOURNAL_REFUND only */
+    uint32_t crc; /* CRC-32 of the fields above */
+};
+
+/* Handler of a replayed record */
+typedef void (*journal_replay_t)(const struct journal_record *rec);
+
+/* Counters of the journal */
+struct journal_stats {
+    uint32_t staged; /* Records accepted by journal_append() */
+    uint32_t appends; /* Records written to flash */
+    uint32_t writes; /* Flash writes, each a run of records */
+    uint32_t append_us; /* Total time spent writing them */
+    uint32_t max_append_us; /* Worst write */
+    uint32_t pending; /* Records staged and not yet written */
+    uint32_t compactions; /* Sectors erased */
+    uint32_t stalls; /* Flushes that found the next sector not erased */
+    uint32_t dropped; /* Records refused, ring full or journal not usable */
+    uint32_t write_errors; /* Failed flushes, records kept and written again */
+    int32_t last_error; /* Error code of the last failed flush */
+    uint32_t compact_errors; /* Compactions retried, snapshot or erase failed */
+    uint32_t scanned; /* Valid records found at boot */
+    uint32_t replayed; /* Records newer than the snapshot */
+    uint32_t corrupt; /* Torn or damaged records skipped at boot */
+    uint32_t lost; /* Records after a missing one, not replayed */
+    uint32_t replay_us; /* Time of the boot scan and replay */
+};
+
+int journal_init(uint32_t snapshot_seq, journal_replay_t replay);
+int journal_append(uint8_t type, int16_t product, int amount, int32_t credit,
+                   const struct change_coins *coins);
+uint32_t journal_last_seq(void);
+void journal_stats_get(struct journal_stats *stats);
+void journal_report(void);
+
+#endif /* JOURNAL_H */
@@ -0,0 +1,193 @@
+/** @file latency.c
+ * @brief Implementation of the press-to-response latency histograms
+ *
+ * For each input the time from the edge (taken
+ * in the ISR) to the end of its state handler
+ * is stored in a histogram with power of two
+ * buckets, so recording a sample is a few
+ * instructions and the memory is fixed.
+ * The histograms are printed on demand from
+ * the console, see uart_cmd.c.
+ *
+ * The time spent in the state machine alone
+ * (handling time) is kept per input as well,
+ * for the trace replay.
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#include <zephyr.h>
+#include <sys/printk.h>
+#include <string.h>
+
+#include "latency.h"
+
+/* Names of the inputs, in the order of the events */
+static const char *const input_names[LATENCY_N_INPUTS] = {
+    "up", "down", "select", "return", "c10", "c20", "c50", "c100",
+};
+
+static struct latency_hist hists[LATENCY_N_INPUTS]; /* One histogram per input */
+static struct latency_handling handling[LATENCY_N_INPUTS]; /* Handling time of each input */
+
+/**
+ * @brief latency_record function add a sample to the histogram of an input
+ *
+ * latency_record is called when the handler
+ * of the input has finished.
+ *
+ * @param input input index (event id)
+ * @param pressed timestamp of the edge, from the ISR
+ */
+
+void latency_record(uint8_t input, timing_t pressed){
+    struct latency_hist *hist;
+    timing_t now = timing_counter_get();
+    uint32_t us = (uint32_t)(timing_cycles_to_ns(timing_cycles_get(&pressed, &now)) / 1000);
+    uint32_t bucket;
+
+    if (input >= LATENCY_N_INPUTS) {
+        return;
+    }
+    hist = &hists[input];
+
+    bucket = us == 0 ? 0 : find_msb_set(us) - 1;
+    if (bucket >= LATENCY_N_BUCKETS) {
+        bucket = LATENCY_N_BUCKETS - 1;
+    }
+    hist->buckets[bucket]++;
+
+    if (hist->count == 0 || us < hist->min_us) {
+        hist->min_us = us;
+    }
+    if (us > hist->max_us) {
+        hist->max_us = us;
+    }
+    hist->count++;
+}
+
+/**
+ * @brief latency_p99_us function compute the 99th percentile of a histogram
+ *
+ * The result is the upper bound of the bucket
+ * holding the 99th percentile, capped to the
+ * maximum, so it is never below the real value.
+ *
+ * @param hist histogram
+ * @return 99th percentile in us
+ */
+
+uint32_t latency_p99_us(const struct latency_hist *hist){
+    uint32_t target = hist->count - hist->count / 100; /* Samples at or below p99 */
+    uint32_t seen = 0;
+
+    if (hist->count == 0) {
+        return 0;
+    }
+    for (int i = 0; i < LATENCY_N_BUCKETS - 1; i++) {
+        seen += hist->buckets[i];
+        if (seen >= target) {
+            return MIN((uint32_t)BIT(i + 1) - 1, hist->max_us);
+        }
+    }
+    return hist->max_us;
+}
+
+/**
+ * @brief latency_handled function add a handling time sample
+ *
+ * latency_handled is called when the state
+ * machine has finished with the input.
+ *
+ * @param input input index (event id)
+ * @param started timestamp taken before fsm_dispatch()
+ */
+
+void latency_handled(uint8_t input, timing_t started){
+    timing_t now = timing_counter_get();
+    uint32_t ns = (uint32_t)timing_cycles_to_ns(timing_cycles_get(&started, &now));
+
+    if (input >= LATENCY_N_INPUTS) {
+        return;
+    }
+    handling[input].count++;
+    handling[input].total_ns += ns;
+    handling[input].max_ns = MAX(handling[input].max_ns, ns);
+}
+
+/**
+ * @brief latency_handling_get function read the handling time of an input
+ *
+ * @param input input index (event id)
+ * @param out where the counters are copied
+ */
+
+void latency_handling_get(uint8_t input, struct latency_handling *out){
+    *out = handling[input];
+}
+
+/**
+ * @brief latency_input_name function return the name of an input
+ *
+ * @param input input index (event id)
+ * @return name, as printed by latency_dump()
+ */
+
+const char *latency_input_name(uint8_t input){
+    return input < LATENCY_N_INPUTS ? input_names[input] : "?";
+}
+
+/**
+ * @brief latency_get function read the histogram of an input
+ *
+ * @param input event of the input, EV_UP ... EV_C100
+ * @param out where the histogram is copied
+ */
+
+void latency_get(uint8_t input, struct latency_hist *out){
+    *out = hists[input];
+}
+
+/**
+ * @brief latency_dump function print the histograms
+ *
+ * One line per input with count, min, max and
+ * p99, followed by the non empty buckets.
+ *
+ */
+
+void latency_dump(void){
+    for (int i = 0; i < LATENCY_N_INPUTS; i++) {
+        const struct latency_hist *hist = &hists[i];
+
+        printk("%-6s n=%u min=%u us max=%u us p99=%u us\n", input_names[i], hist->count,
+               hist->min_us, hist->max_us, latency_p99_us(hist));
+        for (int b = 0; b < LATENCY_N_BUCKETS; b++) {
+            if (hist->buckets[b] == 0) {
+                continue;
+            }
+            if (b == LATENCY_N_BUCKETS - 1) {
+                printk("    >= %u us: %u\n", (uint32_t)BIT(b), hist->buckets[b]);
+            } else {
+                printk("    [%u us, %u us): %u\n", b == 0 ? 0 : (uint32_t)BIT(b),
+                       (uint32_t)BIT(b + 1), hist->buckets[b]);
+            }
+        }
+    }
+}
+
+/**
+ * @brief latency_reset function clear the histograms
+ *
+ * Must run in the transaction thread, which
+ * records the samples; the command channel
+ * asks for it with vending_inject(VENDING_RESET).
+ *
+ */
+
+void latency_reset(void){
+    memset(hists, 0, sizeof(hists));
+    memset(handling, 0, sizeof(handling));
+}
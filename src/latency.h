@@ -0,0 +1,42 @@
+/** @file latency.h
+ * @brief Declarations of the press-to-response latency histograms
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <zephyr.h>
+#include <timing/timing.h>
+
+#define LATENCY_N_INPUTS 8 /* up, down, select, return, c10, c20, c50, c100 */
+#define LATENCY_N_BUCKETS 16 /* Bucket i counts latencies in [2^i, 2^(i+1)) us, bucket 0 from 0 and the last one everything above */
+
+/* Latency statistics of one input */
+struct latency_hist {
+    uint32_t count; /* Number of samples */
+    uint32_t min_us; /* Best latency */
+    uint32_t max_us; /* Worst latency */
+    uint32_t buckets[LATENCY_N_BUCKETS]; /* Histogram */
+};
+
+/* Time spent by the state machine on one input */
+struct latency_handling {
+    uint32_t count; /* Number of samples */
+    uint32_t max_ns; /* Worst handling time */
+    uint64_t total_ns; /* Sum of the handling times */
+};
+
+void latency_record(uint8_t input, timing_t pressed);
+void latency_handled(uint8_t input, timing_t started);
+void latency_handling_get(uint8_t input, struct latency_handling *out);
+const char *latency_input_name(uint8_t input);
+void latency_get(uint8_t input, struct latency_hist *out);
+uint32_t latency_p99_us(const struct latency_hist *hist);
+void latency_dump(void);
+void latency_reset(void);
+
+#endif /* LATENCY_H */
@@ -0,0 +1,364 @@
+/** @file loadgen.c
+ * @brief Load generator for the native build
+ *
+ * On native_posix the buttons are pins of the
+ * emulated GPIO controller. This thread drives
+ * them like a stream of customers: a seeded, so
+ * reproducible, random sequence of coins, browse,
+ * select and return presses goes through the real
+ * ISR, input ring and state machine. At the end
+ * it reports the throughput, the dropped events
+ * and checks that no money was created or lost.
+ *
+ * With CONFIG_APP_LOADGEN_BOUNCE each press also
+ * bounces a few times, and some presses are
+ * replaced by short glitches, so that the
+ * debounce counters can be checked too. The
+ * same seed replays the same bounce trace.
+ *
+ * With CONFIG_APP_COIN_PULSE the coins are
+ * fired as pulse trains on BOARDCOIN, at
+ * 1 / (2 * CONFIG_APP_LOADGEN_PULSE_US), and some
+ * trains with no denomination are mixed in when
+ * the presses bounce; the pulses, coins and
+ * rejected trains counted by coin_pulse.c are
+ * checked against what was fired.
+ *
+ * With CONFIG_APP_LOADGEN_FLOOD the log queue is
+ * filled before every press, and the worst
+ * latency of the coins shows how well the input
+ * and transaction threads are isolated from a
+ * saturated output thread.
+ *
+ * At the end CONFIG_APP_LOADGEN_BURST coin
+ * presses are queued back to back with the
+ * interrupts locked, more than the ring holds:
+ * the presses stored must be handled exactly
+ * once and the others counted as overflows.
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#include <zephyr.h>
+#include <device.h>
+#include <drivers/gpio.h>
+#include <drivers/gpio/gpio_emul.h>
+#include <sys/printk.h>
+#include <native_rtc.h>
+#include <posix_board_if.h>
+
+#include "applog.h"
+#include "coin_pulse.h"
+#include "debounce.h"
+#include "input_ring.h"
+#include "latency.h"
+#include "machine.h"
+#include "vending.h"
+
+#define LOADGEN_STACK_SIZE 1024 /* Stack of the load generator */
+#define LOADGEN_PRIORITY 7 /* Below the transaction thread, above the log thread */
+#define LOADGEN_START_MS 100 /* Time given to main() to configure the buttons */
+#define LOADGEN_MAX_BOUNCES 4 /* Extra edges of a bouncing press, at most */
+#define LOADGEN_GLITCH_PCT 5 /* Presses replaced by a glitch, in percent */
+#define LOADGEN_N_COINS (EV_C100 - EV_C10 + 1) /* Coin inputs, EV_C10 to EV_C100 */
+#define LOADGEN_BAD_TRAIN 3 /* Pulses of a train with no denomination */
+
+/* A kind of press and how often it happens, out of 100 */
+struct loadgen_input {
+    gpio_pin_t pin; /* Button pressed */
+    uint8_t weight; /* Probability in percent */
+    uint8_t cents; /* Value of the coin, 0 for the other buttons */
+};
+
+/* Outcome of the final burst */
+struct loadgen_burst {
+    uint32_t stored; /* Presses taken by the ring */
+    uint32_t dropped; /* Presses refused, ring full */
+    uint32_t cents; /* Value of the coins stored */
+    uint32_t handled; /* Coins handled by the state machine during the burst */
+};
+
+/* Mix of presses of an average customer */
+static const struct loadgen_input mix[] = {
+    { BOARDBUT1, 10, 0 }, /* up */
+    { BOARDBUT2, 10, 0 }, /* down */
+    { BOARDBUT3, 15, 0 }, /* select */
+    { BOARDBUT4, 10, 0 }, /* return */
+    { BOARDBUT5, 15, 10 }, /* 10 cents */
+    { BOARDBUT6, 15, 20 }, /* 20 cents */
+    { BOARDBUT7, 15, 50 }, /* 50 cents */
+    { BOARDBUT8, 10, 100 }, /* 1 EUR */
+};
+
+/**
+ * @brief loadgen_rand function next pseudo random number
+ *
+ * xorshift32, fast and reproducible from the seed
+ *
+ * @param state generator state, never zero
+ * @return pseudo random number
+ */
+
+static uint32_t loadgen_rand(uint32_t *state){
+    uint32_t x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+/**
+ * @brief loadgen_pick function choose the next press
+ *
+ * @param state generator state
+ * @return input to press
+ */
+
+static const struct loadgen_input *loadgen_pick(uint32_t *state){
+    uint32_t r = loadgen_rand(state) % 100;
+
+    for (int i = 0; i < ARRAY_SIZE(mix); i++) {
+        if (r < mix[i].weight) {
+            return &mix[i];
+        }
+        r -= mix[i].weight;
+    }
+    return &mix[ARRAY_SIZE(mix) - 1];
+}
+
+#ifdef CONFIG_APP_COIN_PULSE
+
+/**
+ * @brief loadgen_train function fire a pulse train on the coin line
+ *
+ * k_busy_wait() advances the simulated time,
+ * so the pulses have the exact width.
+ *
+ * @param dev emulated GPIO controller
+ * @param pulses length of the train
+ */
+
+static void loadgen_train(const struct device *dev, uint8_t pulses){
+    for (uint8_t i = 0; i < pulses; i++) {
+        gpio_emul_input_set(dev, BOARDCOIN, 1);
+        k_busy_wait(CONFIG_APP_LOADGEN_PULSE_US);
+        gpio_emul_input_set(dev, BOARDCOIN, 0);
+        k_busy_wait(CONFIG_APP_LOADGEN_PULSE_US);
+    }
+}
+
+#endif /* CONFIG_APP_COIN_PULSE */
+
+/**
+ * @brief loadgen_drain function wait until every queued press is handled
+ *
+ * @param ring where the ring counters are copied
+ */
+
+static void loadgen_drain(struct input_ring_stats *ring){
+    do {
+        k_msleep(1);
+        input_ring_stats_get(ring);
+    } while (ring->popped != ring->pushed || vending_pending() != 0);
+}
+
+/**
+ * @brief loadgen_coins_handled function count the coins handled so far
+ *
+ * @return samples of the latency histograms of the coin inputs
+ */
+
+static uint32_t loadgen_coins_handled(void){
+    struct latency_hist hist;
+    uint32_t count = 0;
+
+    for (int i = 0; i < LOADGEN_N_COINS; i++) {
+        latency_get(EV_C10 + i, &hist);
+        count += hist.count;
+    }
+    return count;
+}
+
+/**
+ * @brief loadgen_burst function queue coin presses faster than they are handled
+ *
+ * The interrupts stay locked for the whole
+ * burst, like in a long ISR, so the input thread
+ * cannot drain the ring in between.
+ *
+ * @param out outcome of the burst
+ */
+
+static void loadgen_burst(struct loadgen_burst *out){
+    uint32_t handled = loadgen_coins_handled();
+    struct input_ring_stats ring;
+    unsigned int key = irq_lock();
+
+    for (uint32_t n = 0; n < CONFIG_APP_LOADGEN_BURST; n++) {
+        const struct loadgen_input *coin = &mix[ARRAY_SIZE(mix) - LOADGEN_N_COINS + n % LOADGEN_N_COINS];
+
+        if (vending_press(coin->pin)) {
+            out->stored++;
+            out->cents += coin->cents;
+        } else {
+            out->dropped++;
+        }
+    }
+    irq_unlock(key);
+
+    loadgen_drain(&ring);
+    out->handled = loadgen_coins_handled() - handled;
+}
+
+/**
+ * @brief loadgen_thread function run the load and print the report
+ *
+ */
+
+static void loadgen_thread(void){
+    const struct device *gpio0_dev = device_get_binding(DT_LABEL(GPIO0_NID));
+    uint32_t seed = CONFIG_APP_LOADGEN_SEED ? CONFIG_APP_LOADGEN_SEED : 1;
+    uint32_t inserted = 0; /* Cents inserted by the generator */
+    uint32_t presses = 0; /* Real presses fired */
+    uint32_t bounces = 0; /* Bounce edges fired */
+    uint32_t glitches = 0; /* Glitches fired */
+#ifdef CONFIG_APP_COIN_PULSE
+    uint32_t pulses = 0; /* Pulses fired on the coin line */
+    uint32_t coins = 0; /* Trains of a coin fired */
+    uint32_t bad_trains = 0; /* Trains with no denomination fired */
+    struct coin_pulse_stats acceptor;
+#endif
+    struct input_ring_stats ring;
+    struct loadgen_burst burst = { 0 };
+    struct debounce_stats deb;
+    struct applog_stats log;
+    struct vending_totals totals;
+    struct vending_totals before; /* Totals restored from flash */
+    int64_t sim_start = k_uptime_get();
+    uint64_t host_start = native_rtc_gettime_us(RTC_CLOCK_REALTIME);
+    uint64_t host_us;
+    uint32_t coin_p99_us = 0; /* Worst p99 latency of the coin inputs */
+    uint32_t coin_max_us = 0; /* Worst latency of the coin inputs */
+    bool ok;
+
+    vending_totals_get(&before);
+    printk("Load generator: %u events, seed %u\n", CONFIG_APP_LOADGEN_EVENTS, seed);
+
+    for (uint32_t n = 0; n < CONFIG_APP_LOADGEN_EVENTS; n++) {
+        const struct loadgen_input *in = loadgen_pick(&seed);
+
+        if (IS_ENABLED(CONFIG_APP_LOADGEN_FLOOD)) {
+            for (int i = 0; i < APPLOG_QUEUE_LEN; i++) {
+                applog_put(APPLOG_PRODUCT, 1, 0);
+            }
+        }
+
+#ifdef CONFIG_APP_COIN_PULSE
+        if (in->cents > 0) {
+            uint8_t train = coin_pulse_pulses(in->pin);
+
+            if (IS_ENABLED(CONFIG_APP_LOADGEN_BOUNCE) && loadgen_rand(&seed) % 100 < LOADGEN_GLITCH_PCT) {
+                train = LOADGEN_BAD_TRAIN;
+                bad_trains++;
+            } else {
+                coins++;
+                inserted += in->cents;
+            }
+            loadgen_train(gpio0_dev, train);
+            pulses += train;
+            /* The counter is read every COIN_PULSE_POLL_MS until the gap */
+            k_msleep(CONFIG_APP_COIN_PULSE_GAP_MS + 2 * COIN_PULSE_POLL_MS);
+            continue;
+        }
+#endif
+
+        /* Rising edge, the interrupt is GPIO_INT_EDGE_TO_ACTIVE */
+        gpio_emul_input_set(gpio0_dev, in->pin, 0);
+        gpio_emul_input_set(gpio0_dev, in->pin, 1);
+
+        if (IS_ENABLED(CONFIG_APP_LOADGEN_BOUNCE) && loadgen_rand(&seed) % 100 < LOADGEN_GLITCH_PCT) {
+            /* Back to inactive before the window ends */
+            gpio_emul_input_set(gpio0_dev, in->pin, 0);
+            glitches++;
+        } else {
+            if (IS_ENABLED(CONFIG_APP_LOADGEN_BOUNCE)) {
+                uint32_t n_bounces = loadgen_rand(&seed) % (LOADGEN_MAX_BOUNCES + 1);
+
+                for (uint32_t b = 0; b < n_bounces; b++) {
+                    gpio_emul_input_set(gpio0_dev, in->pin, 0);
+                    gpio_emul_input_set(gpio0_dev, in->pin, 1);
+                }
+                bounces += n_bounces;
+            }
+            presses++;
+            inserted += in->cents;
+        }
+
+        /* Simulated time, costs nothing on the host */
+        k_msleep(debounce_window_get(in->pin) + 1);
+        gpio_emul_input_set(gpio0_dev, in->pin, 0);
+    }
+
+    /* Let the state machine handle what is still queued */
+    loadgen_drain(&ring);
+    if (CONFIG_APP_LOADGEN_BURST > 0) {
+        loadgen_burst(&burst);
+        input_ring_stats_get(&ring);
+    }
+
+    host_us = native_rtc_gettime_us(RTC_CLOCK_REALTIME) - host_start;
+    applog_stats_get(&log);
+    debounce_stats_get(&deb);
+    vending_totals_get(&totals);
+
+    printk("Events: %u in %u ms host time (%u events/s), %u ms simulated\n",
+           ring.pushed + ring.overflows, (uint32_t)(host_us / 1000),
+           (uint32_t)((uint64_t)ring.pushed * 1000000 / MAX(host_us, 1)),
+           (uint32_t)(k_uptime_get() - sim_start));
+    printk("Dropped: %u input, %u log records\n", ring.overflows, log.dropped);
+    printk("Burst: %u coins, %u stored, %u handled, %u dropped\n", CONFIG_APP_LOADGEN_BURST,
+           burst.stored, burst.handled, burst.dropped);
+    printk("Output: %u bytes, %u ns per byte in the log thread, worst applog_put %u ns\n",
+           log.bytes, (uint32_t)(log.write_ns / MAX(log.bytes, 1)), log.max_put_ns);
+    printk("Debounce: %u edges, %u presses, %u bounces, %u glitches\n",
+           deb.edges, deb.presses, deb.bounces, deb.glitches);
+#ifdef CONFIG_APP_COIN_PULSE
+    coin_pulse_stats_get(&acceptor);
+    printk("Coin trains at %u Hz: %u pulses, %u coins, %u rejected; %u interrupts, %u reads\n",
+           500000 / CONFIG_APP_LOADGEN_PULSE_US, acceptor.pulses, acceptor.coins,
+           acceptor.rejected, acceptor.wakeups, acceptor.polls);
+#endif
+    for (int i = 0; i < LOADGEN_N_COINS; i++) {
+        struct latency_hist hist;
+
+        latency_get(EV_C10 + i, &hist);
+        coin_max_us = MAX(coin_max_us, hist.max_us);
+        coin_p99_us = MAX(coin_p99_us, latency_p99_us(&hist));
+    }
+    printk("Coin acceptance: worst p99 %u us, max %u us%s\n", coin_p99_us, coin_max_us,
+           IS_ENABLED(CONFIG_APP_LOADGEN_FLOOD) ? " with the output saturated" : "");
+    printk("Inserted %u, spent %u, returned %u, credit %d, vends %u, refused %u\n",
+           totals.inserted, totals.spent, totals.returned, totals.credit,
+           totals.vends, totals.failed);
+
+    /* Only the burst overflows the ring, and what it stored is handled once */
+    ok = ring.overflows == burst.dropped && burst.handled == burst.stored &&
+         burst.stored + burst.dropped == CONFIG_APP_LOADGEN_BURST &&
+         deb.presses == presses && deb.bounces == bounces && deb.glitches == glitches &&
+         totals.inserted - before.inserted == inserted + burst.cents &&
+         totals.inserted == totals.spent + totals.returned + totals.credit;
+#ifdef CONFIG_APP_COIN_PULSE
+    ok = ok && acceptor.pulses == pulses && acceptor.coins == coins &&
+         acceptor.rejected == bad_trains;
+#endif
+    printk("Invariants: %s\n", ok ? "OK" : "FAILED");
+
+    posix_exit(ok ? 0 : 1);
+}
+
+K_THREAD_DEFINE(loadgen_tid, LOADGEN_STACK_SIZE, loadgen_thread, NULL, NULL, NULL,
+                LOADGEN_PRIORITY, 0, LOADGEN_START_MS);
@@ -0,0 +1,478 @@
+/** @file machine.c
+ * @brief Implementation of the vending machine state machine
+ *
+ * The states and their actions. Each action finds
+ * its machine from the state machine instance it
+ * gets, and touches nothing else but the hooks,
+ * so machine_step() is reentrant: different
+ * machines can be stepped by different threads
+ * at the same time.
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#include <zephyr.h>
+#include <string.h>
+
+#include "applog.h"
+#include "machine.h"
+
+/*Define of states machine*/
+#define IDLE 0
+#define BROWSE_UP 1
+#define BROWSE_DOWN 2
+#define DISPENSING 3 /* Superstate of COMPARISON, ERROR, OK, PAYOUT and DISPENSE */
+#define RETURNING 4
+#define CENT10 5
+#define CENT20 6
+#define CENT50 7
+#define CENT100 8
+#define COMPARISON 9
+#define ERROR 10
+#define OK 11
+#define DISPENSE 12
+#define PAYOUT 13
+#define VENDED 14
+#define N_STATES 15
+
+/* Machine owning a state machine instance */
+#define MACHINE(f) CONTAINER_OF(f, struct machine, fsm)
+
+/**
+ * @brief machine_log function send a message through the log hook
+ *
+ * @param m machine
+ * @param id message id (APPLOG_xxx)
+ * @param product product the message refers to
+ * @param credit credit or amount in cents
+ */
+
+static void machine_log(struct machine *m, uint8_t id, int16_t product, int32_t credit){
+    if(m->ops->log != NULL){
+        m->ops->log(m, id, product, credit);
+    }
+}
+
+/**
+ * @brief machine_record function report a change through the record hook
+ *
+ * @param m machine
+ * @param type MACHINE_COIN_IN ... MACHINE_REFUND
+ * @param amount coin, price or refund in cents
+ * @param coins coins paid by a refund, NULL otherwise
+ */
+
+static void machine_record(struct machine *m, uint8_t type, int amount,
+                           const struct change_coins *coins){
+    if(m->ops->record != NULL){
+        m->ops->record(m, type, m->sel_prod, amount, coins);
+    }
+}
+
+/**
+ * @brief machine_set_credit function change the credit
+ *
+ * machine_set_credit must be used for every
+ * change of the credit, so that the affordable
+ * products of the catalog stay up to date
+ *
+ * @param m machine
+ * @param credit new credit in cents
+ */
+
+void machine_set_credit(struct machine *m, int credit){
+    m->credit = credit;
+    catalog_credit_changed(&m->catalog, credit);
+}
+
+/**
+ * @brief machine_totals_get function read the totals of a machine
+ *
+ * Inserted money is always equal to the
+ * current credit plus spent and returned
+ * money.
+ *
+ * @param m machine
+ * @param out where the totals are copied
+ */
+
+void machine_totals_get(const struct machine *m, struct vending_totals *out){
+    *out = m->totals;
+    out->credit = m->credit;
+}
+
+/**
+ * @brief print_product function print the selected product
+ *
+ * print_product prints the name and
+ * price of the selected product
+ * followed by the credit
+ *
+ * @param m machine
+ */
+
+static void print_product(struct machine *m){
+    machine_log(m, APPLOG_PRODUCT, m->sel_prod, m->credit);
+}
+
+/**
+ * @brief browse_up_entry function select the next product
+ *
+ * @param fsm state machine of the machine
+ * @return EV_DONE
+ */
+
+static uint8_t browse_up_entry(struct fsm *fsm){
+    struct machine *m = MACHINE(fsm);
+
+    if(m->sel_prod<CATALOG_SIZE){
+        m->sel_prod=m->sel_prod+1;
+    }
+    print_product(m);
+    return EV_DONE;
+}
+
+/**
+ * @brief browse_down_entry function select the previous product
+ *
+ * @param fsm state machine of the machine
+ * @return EV_DONE
+ */
+
+static uint8_t browse_down_entry(struct fsm *fsm){
+    struct machine *m = MACHINE(fsm);
+
+    if(m->sel_prod>1){
+        m->sel_prod=m->sel_prod-1;
+    }
+    print_product(m);
+    return EV_DONE;
+}
+
+/**
+ * @brief check_exact_change function report a change of the exact change flag
+ *
+ * @param m machine
+ * @param before flag before the coins moved
+ */
+
+static void check_exact_change(struct machine *m, bool before){
+    if(change_exact_only(&m->tubes) != before){
+        machine_log(m, APPLOG_EXACT_CHANGE, m->sel_prod, change_exact_only(&m->tubes));
+    }
+}
+
+/**
+ * @brief pay_change function give the credit back in coins
+ *
+ * The coins come from the tubes; what cannot
+ * be paid stays as credit.
+ *
+ * @param m machine
+ * @return amount paid in cents
+ */
+
+static int pay_change(struct machine *m){
+    bool exact = change_exact_only(&m->tubes);
+    struct change_coins coins;
+    int paid = change_pay(&m->tubes, m->credit, &coins);
+
+    m->totals.returned += paid;
+    machine_set_credit(m, m->credit-paid);
+    if(paid>0){
+        machine_record(m, MACHINE_REFUND, paid, &coins);
+    }
+    check_exact_change(m, exact);
+    return paid;
+}
+
+/**
+ * @brief returning_entry function return the whole credit
+ *
+ * @param fsm state machine of the machine
+ * @return EV_DONE
+ */
+
+static uint8_t returning_entry(struct fsm *fsm){
+    struct machine *m = MACHINE(fsm);
+    int paid = pay_change(m);
+
+    machine_log(m, APPLOG_RETURN, m->sel_prod, paid);
+    if(m->credit>0){
+        machine_log(m, APPLOG_CREDIT, m->sel_prod, m->credit);
+    }
+    return EV_DONE;
+}
+
+/**
+ * @brief insert_coin function add a coin to the credit
+ *
+ * @param m machine
+ * @param cents value of the coin
+ * @return EV_DONE
+ */
+
+static uint8_t insert_coin(struct machine *m, int cents){
+    bool exact = change_exact_only(&m->tubes);
+
+    m->totals.inserted += cents;
+    change_coin_in(&m->tubes, cents);
+    machine_set_credit(m, m->credit+cents);
+    machine_record(m, MACHINE_COIN_IN, cents, NULL);
+    machine_log(m, APPLOG_CREDIT, m->sel_prod, m->credit);
+    check_exact_change(m, exact);
+    return EV_DONE;
+}
+
+static uint8_t cent10_entry(struct fsm *fsm){ return insert_coin(MACHINE(fsm), 10); }
+static uint8_t cent20_entry(struct fsm *fsm){ return insert_coin(MACHINE(fsm), 20); }
+static uint8_t cent50_entry(struct fsm *fsm){ return insert_coin(MACHINE(fsm), 50); }
+static uint8_t cent100_entry(struct fsm *fsm){ return insert_coin(MACHINE(fsm), 100); }
+
+/**
+ * @brief machine_busy function check the dispenser of a machine
+ *
+ * @param m machine
+ * @return true if the dispenser cannot take a product now
+ */
+
+static bool machine_busy(struct machine *m){
+    return m->ops->busy != NULL && m->ops->busy(m);
+}
+
+/**
+ * @brief comparison_entry function check credit and stock of the product
+ *
+ * @param fsm state machine of the machine
+ * @return EV_CREDIT_OK if the product can be dispensed, EV_CREDIT_LOW otherwise
+ */
+
+static uint8_t comparison_entry(struct fsm *fsm){
+    struct machine *m = MACHINE(fsm);
+
+    if(catalog_affordable(&m->catalog, m->sel_prod) && catalog_stock(&m->catalog, m->sel_prod)>0 &&
+       !machine_busy(m)){
+        return EV_CREDIT_OK;
+    }
+    return EV_CREDIT_LOW;
+}
+
+/**
+ * @brief error_entry function report why the product is not dispensed
+ *
+ * @param fsm state machine of the machine
+ * @return EV_DONE
+ */
+
+static uint8_t error_entry(struct fsm *fsm){
+    struct machine *m = MACHINE(fsm);
+
+    m->totals.failed++;
+    machine_record(m, MACHINE_VEND_FAILED, 0, NULL);
+    if(catalog_stock(&m->catalog, m->sel_prod)==0){
+        machine_log(m, APPLOG_SOLD_OUT, m->sel_prod, m->credit);
+    }
+    else if(!catalog_affordable(&m->catalog, m->sel_prod)){
+        machine_log(m, APPLOG_NO_CREDIT, m->sel_prod, m->credit);
+    }
+    else{
+        machine_log(m, APPLOG_BUSY, m->sel_prod, m->credit);
+    }
+    return EV_DONE;
+}
+
+/**
+ * @brief ok_entry function charge the product and queue its vend
+ *
+ * The sale is complete here: the product is
+ * taken from the catalog and paid, and the
+ * dispenser drops it while the machine goes
+ * on taking coins.
+ *
+ * @param fsm state machine of the machine
+ * @return EV_DONE
+ */
+
+static uint8_t ok_entry(struct fsm *fsm){
+    struct machine *m = MACHINE(fsm);
+    const struct product *prod = catalog_get(m->sel_prod);
+
+    catalog_take(&m->catalog, m->sel_prod);
+    machine_set_credit(m, m->credit-prod->price);
+    m->totals.spent += prod->price;
+    m->totals.vends++;
+    machine_record(m, MACHINE_VEND, prod->price, NULL);
+    /* comparison_entry has checked there is room */
+    if(m->ops->vend != NULL){
+        m->ops->vend(m, m->sel_prod);
+    }
+    return EV_DONE;
+}
+
+/**
+ * @brief payout_entry function give the change after a sale
+ *
+ * @param fsm state machine of the machine
+ * @return EV_DONE
+ */
+
+static uint8_t payout_entry(struct fsm *fsm){
+    struct machine *m = MACHINE(fsm);
+
+    if(m->credit>0){
+        machine_log(m, APPLOG_CHANGE, m->sel_prod, pay_change(m));
+        if(m->credit>0){
+            machine_log(m, APPLOG_CREDIT, m->sel_prod, m->credit);
+        }
+    }
+    return EV_DONE;
+}
+
+/**
+ * @brief dispense_entry function end the dispensing procedure
+ *
+ * @param fsm state machine of the machine
+ * @return EV_DONE
+ */
+
+static uint8_t dispense_entry(struct fsm *fsm){
+    return EV_DONE;
+}
+
+/**
+ * @brief vended_entry function report a product dropped by the dispenser
+ *
+ * @param fsm state machine of the machine
+ * @return EV_DONE
+ */
+
+static uint8_t vended_entry(struct fsm *fsm){
+    struct machine *m = MACHINE(fsm);
+
+    machine_log(m, APPLOG_DISPENSED, m->vended, m->credit);
+    /* The product dropped is not the selected one */
+    if(m->ops->record != NULL){
+        m->ops->record(m, MACHINE_VENDED, m->vended, 0, NULL);
+    }
+    return EV_DONE;
+}
+
+/* States of the vending machine */
+static const struct fsm_state vending_states[N_STATES] = {
+    [IDLE] = { "IDLE", FSM_NONE, NULL, NULL },
+    [BROWSE_UP] = { "BROWSE_UP", FSM_NONE, browse_up_entry, NULL },
+    [BROWSE_DOWN] = { "BROWSE_DOWN", FSM_NONE, browse_down_entry, NULL },
+    [DISPENSING] = { "DISPENSING", FSM_NONE, NULL, NULL },
+    [RETURNING] = { "RETURNING", FSM_NONE, returning_entry, NULL },
+    [CENT10] = { "CENT10", FSM_NONE, cent10_entry, NULL },
+    [CENT20] = { "CENT20", FSM_NONE, cent20_entry, NULL },
+    [CENT50] = { "CENT50", FSM_NONE, cent50_entry, NULL },
+    [CENT100] = { "CENT100", FSM_NONE, cent100_entry, NULL },
+    [COMPARISON] = { "COMPARISON", DISPENSING, comparison_entry, NULL },
+    [ERROR] = { "ERROR", DISPENSING, error_entry, NULL },
+    [OK] = { "OK", DISPENSING, ok_entry, NULL },
+    [DISPENSE] = { "DISPENSE", DISPENSING, dispense_entry, NULL },
+    [PAYOUT] = { "PAYOUT", DISPENSING, payout_entry, NULL },
+    [VENDED] = { "VENDED", FSM_NONE, vended_entry, NULL },
+};
+
+/**
+ * @brief machine_state_name function name of a state
+ *
+ * @param state state index, as in APPLOG_STATE records
+ * @return name of the state
+ */
+
+const char *machine_state_name(uint8_t state){
+    return state < N_STATES ? vending_states[state].name : "?";
+}
+
+/* Transitions of the vending machine, [state][event] */
+static const uint8_t vending_table[N_STATES][N_EVENTS] = {
+    [IDLE] = {
+        [EV_UP] = FSM_TO(BROWSE_UP),
+        [EV_DOWN] = FSM_TO(BROWSE_DOWN),
+        [EV_SELECT] = FSM_TO(COMPARISON),
+        [EV_RETURN] = FSM_TO(RETURNING),
+        [EV_C10] = FSM_TO(CENT10),
+        [EV_C20] = FSM_TO(CENT20),
+        [EV_C50] = FSM_TO(CENT50),
+        [EV_C100] = FSM_TO(CENT100),
+        [EV_VEND_DONE] = FSM_TO(VENDED),
+    },
+    [BROWSE_UP] = { [EV_DONE] = FSM_TO(IDLE) },
+    [BROWSE_DOWN] = { [EV_DONE] = FSM_TO(IDLE) },
+    [RETURNING] = { [EV_DONE] = FSM_TO(IDLE) },
+    [CENT10] = { [EV_DONE] = FSM_TO(IDLE) },
+    [CENT20] = { [EV_DONE] = FSM_TO(IDLE) },
+    [CENT50] = { [EV_DONE] = FSM_TO(IDLE) },
+    [CENT100] = { [EV_DONE] = FSM_TO(IDLE) },
+    [COMPARISON] = {
+        [EV_CREDIT_OK] = FSM_TO(OK),
+        [EV_CREDIT_LOW] = FSM_TO(ERROR),
+    },
+    [ERROR] = { [EV_DONE] = FSM_TO(DISPENSE) },
+    [OK] = { [EV_DONE] = FSM_TO(PAYOUT) },
+    [PAYOUT] = { [EV_DONE] = FSM_TO(DISPENSE) },
+    [DISPENSE] = { [EV_DONE] = FSM_TO(IDLE) },
+    [VENDED] = { [EV_DONE] = FSM_TO(IDLE) },
+};
+
+static const struct fsm_desc vending_desc = {
+    .states = vending_states,
+    .table = &vending_table[0][0],
+    .n_states = N_STATES,
+    .n_events = N_EVENTS,
+};
+
+/**
+ * @brief machine_init function start a full machine in IDLE
+ *
+ * catalog_init() and change_init() must have
+ * been called once before.
+ *
+ * @param m machine
+ * @param ops hooks of the machine
+ * @param user owner data, stored in the machine
+ */
+
+void machine_init(struct machine *m, const struct machine_ops *ops, void *user){
+    memset(m, 0, sizeof(*m));
+    m->sel_prod = 1;
+    m->ops = ops;
+    m->user = user;
+    catalog_fill(&m->catalog);
+    change_fill(&m->tubes);
+    fsm_init(&m->fsm, &vending_desc, IDLE);
+}
+
+/**
+ * @brief machine_step function run an input event through a machine
+ *
+ * The event runs to completion: when
+ * machine_step returns the machine is back
+ * in IDLE.
+ *
+ * @param m machine
+ * @param event EV_UP ... EV_C100
+ * @return false if the event is not handled
+ */
+
+bool machine_step(struct machine *m, uint8_t event){
+    return fsm_dispatch(&m->fsm, event);
+}
+
+/**
+ * @brief machine_vend_done function tell a machine its product has dropped
+ *
+ * @param m machine
+ * @param product product dropped
+ * @return false if the event is not handled
+ */
+
+bool machine_vend_done(struct machine *m, uint8_t product){
+    m->vended = product;
+    return fsm_dispatch(&m->fsm, EV_VEND_DONE);
+}
@@ -0,0 +1,85 @@
+/** @file machine.h
+ * @brief Declarations of the vending machine state machine
+ *
+ * Everything a machine owns is in struct machine:
+ * selected product, credit, stock, coin tubes,
+ * totals and the state machine instance. The
+ * states and the transition table are const and
+ * shared, so any number of machines can run, each
+ * stepped by one thread at a time. What a machine
+ * does outside itself (log, journal, dispenser)
+ * goes through the hooks of struct machine_ops.
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#ifndef MACHINE_H
+#define MACHINE_H
+
+#include <zephyr.h>
+
+#include "catalog.h"
+#include "change.h"
+#include "fsm.h"
+#include "vending.h"
+
+/*Define of events*/
+#define EV_UP 0 /* BUT1 pressed */
+#define EV_DOWN 1 /* BUT2 pressed */
+#define EV_SELECT 2 /* BUT3 pressed */
+#define EV_RETURN 3 /* BUT4 pressed */
+#define EV_C10 4 /* BUT5 pressed */
+#define EV_C20 5 /* BUT6 pressed */
+#define EV_C50 6 /* BUT7 pressed */
+#define EV_C100 7 /* BUT8 pressed */
+#define EV_DONE 8 /* Action of the state completed */
+#define EV_CREDIT_OK 9 /* Selected product can be dispensed */
+#define EV_CREDIT_LOW 10 /* Selected product cannot be dispensed */
+#define EV_VEND_DONE 11 /* The dispenser has dropped a product */
+#define N_EVENTS 12
+
+/* Kinds of record passed to machine_ops.record, same values as the journal */
+#define MACHINE_COIN_IN 1 /* Coin accepted, amount is its value */
+#define MACHINE_VEND 2 /* Product sold, amount is its price */
+#define MACHINE_VEND_FAILED 3 /* Selection refused */
+#define MACHINE_REFUND 4 /* Credit paid back, amount and coins paid */
+#define MACHINE_VENDED 5 /* Product dropped by the dispenser, amount 0 */
+
+struct machine;
+
+/* Hooks of a machine, any of them can be NULL */
+struct machine_ops {
+    /* Message for the display, see applog.h for the ids */
+    void (*log)(struct machine *m, uint8_t id, int16_t product, int32_t credit);
+    /* Credit, stock or tubes changed, called after the change, or a product dropped */
+    void (*record)(struct machine *m, uint8_t type, int16_t product, int amount,
+                   const struct change_coins *coins);
+    /* Hand a sold product to the dispenser, which posts EV_VEND_DONE when done */
+    void (*vend)(struct machine *m, uint8_t product);
+    /* True if the dispenser cannot take another product */
+    bool (*busy)(struct machine *m);
+};
+
+/* A vending machine */
+struct machine {
+    struct fsm fsm; /* State machine instance */
+    int16_t sel_prod; /* Kind of products, index in the catalog */
+    int32_t credit; /* Credit available */
+    uint8_t vended; /* Product of the EV_VEND_DONE being handled */
+    struct catalog_state catalog; /* Stock and affordable products */
+    struct change_tubes tubes; /* Coins held for change */
+    struct vending_totals totals; /* Money and products handled, credit not updated */
+    const struct machine_ops *ops; /* Hooks */
+    void *user; /* Owner data, not used by the machine */
+};
+
+void machine_init(struct machine *m, const struct machine_ops *ops, void *user);
+bool machine_step(struct machine *m, uint8_t event);
+bool machine_vend_done(struct machine *m, uint8_t product);
+void machine_set_credit(struct machine *m, int credit);
+void machine_totals_get(const struct machine *m, struct vending_totals *out);
+const char *machine_state_name(uint8_t state);
+
+#endif /* MACHINE_H */
@@ -20,191 +20,528 @@
 #include <timing/timing.h>
 #include <stdio.h>
 
-/*Global variables*/
-static int8_t sel_prod=1; /*Kind of products*/
-static int credit=0; /*Credit available*/
-
-/*Price of products*/
-const int beerCost=150;
-const int tunaSandwichCost=100;
-const int coffeeCost=50;
-
-#define SLEEP_MS 5 /* Blink period in ms*/ 
-
-/*Define of states machine*/
-#define IDLE 0
-#define BROWSE_UP 1
-#define BROWSE_DOWN 2
-#define DISPENSING 3
-#define RETURNING 4
-#define CENT10 5
-#define CENT20 6
-#define CENT50 7
-#define CENT100 8
-
-#define COMPARISON 1
-#define ERROR 2
-#define OK 3
-#define DISPENSE 4
-
-/* Refer to dts file */
-#define GPIO0_NID DT_NODELABEL(gpio0) 
-#define BOARDBUT1 0xb /* Pin at which BUT1 is connected. Addressing is direct (i.e., pin number) */
-#define BOARDBUT2 0xc /* Pin at which BUT2 is connected. Addressing is direct (i.e., pin number) */
-#define BOARDBUT3 0x18 /* Pin at which BUT3 is connected. Addressing is direct (i.e., pin number) */
-#define BOARDBUT4 0x19 /* Pin at which BUT4 is connected. Addressing is direct (i.e., pin number) */
-
-#define BOARDBUT5 0x3 /* Pin at which BUT5 is connected. Addressing is direct (i.e., pin number) */
-#define BOARDBUT6 0x4 /* Pin at which BUT6 is connected. Addressing is direct (i.e., pin number) */
-#define BOARDBUT7 0x1C /* Pin at which BUT7 is connected. Addressing is direct (i.e., pin number) */
-#define BOARDBUT8 0x1D /* Pin at which BUT8 is connected. Addressing is direct (i.e., pin number) */
-
+#include "applog.h"
+#include "catalog.h"
+#include "change.h"
+#include "coin_pulse.h"
+#include "debounce.h"
+#include "dispenser.h"
+#include "fsm.h"
+#include "input_ring.h"
+#include "journal.h"
+#include "latency.h"
+#include "machine.h"
+#include "persist.h"
+#include "power.h"
+#include "telemetry.h"
+#include "trace.h"
+#include "uart_tx.h"
+#include "vending.h"
+
+static struct machine vm; /* The vending machine of this board */
+static uint8_t owed[CATALOG_SIZE]; /* Products sold and not yet dropped, see redispense() */
+
+#define EV_QUERY 0xFE /* Not a state machine event: report the state */
+#define EV_RESET 0xFD /* Not a state machine event: clear the latency statistics */
+
+/* Pins of the eight buttons, BUTn is at index n-1 */
+const uint8_t vending_button_pins[VENDING_BUTTONS] = {
+    BOARDBUT1, BOARDBUT2, BOARDBUT3, BOARDBUT4,
+    BOARDBUT5, BOARDBUT6, BOARDBUT7, BOARDBUT8,
+};
+
+/* Debounce window of each button in ms, same order as vending_button_pins */
+static const uint16_t button_debounce_ms[] = {
+    20, 20, 20, 20,
+    5, 5, 5, 5,
+};
+
+#define BUTTONS_MASK (BIT(BOARDBUT1) | BIT(BOARDBUT2) | BIT(BOARDBUT3) | BIT(BOARDBUT4) | \
+                      BIT(BOARDBUT5) | BIT(BOARDBUT6) | BIT(BOARDBUT7) | BIT(BOARDBUT8))
 
 /* Int related declarations */
-static struct gpio_callback but1_cb_data; /* Callback structure */
-static struct gpio_callback but2_cb_data; /* Callback structure */
-static struct gpio_callback but3_cb_data; /* Callback structure */
-static struct gpio_callback but4_cb_data; /* Callback structure */
-static struct gpio_callback but5_cb_data; /* Callback structure */
-static struct gpio_callback but6_cb_data; /* Callback structure */
-static struct gpio_callback but7_cb_data; /* Callback structure */
-static struct gpio_callback but8_cb_data; /* Callback structure */
-
-/* Callback function and variables*/
-volatile bool up = 0; /* Flag to signal a BUT1 press */
-volatile bool down = 0; /* Flag to signal a BUT2 press */
-volatile bool select = 0; /* Flag to signal a BUT3 press */
-volatile bool c_return = 0; /* Flag to signal a BUT4 press */
-volatile bool c10 = 0; /* Flag to signal a BUT5 press */
-volatile bool c20 = 0; /* Flag to signal a BUT6 press */
-volatile bool c50 = 0; /* Flag to signal a BUT7 press */
-volatile bool c100 = 0; /* Flag to signal a BUT8 press */
+static struct gpio_callback buttons_cb_data; /* Callback structure, shared by all buttons */
+
+/* Event dispatching */
+K_SEM_DEFINE(input_sem, 0, 1); /* Given for every stable press, the input thread blocks on it */
+
+/*
+ * Threads: the input thread turns presses into
+ * events, main is the transaction thread and
+ * runs the state machine, applog.c is the
+ * output thread. A coin is taken off the input
+ * ring as soon as it arrives even while a
+ * transaction writes to flash, and output never
+ * delays either of them.
+ */
+#define INPUT_STACK_SIZE 512 /* No printk, only the ring and the queue */
+#define INPUT_PRIORITY 1 /* Above the transaction thread, CONFIG_MAIN_THREAD_PRIORITY */
+#define TXN_QUEUE_LEN 16 /* Events waiting for the transaction thread */
+#define DISPATCH_POLL_MS 5 /* Period of the original main loop, CONFIG_APP_DISPATCH_POLL */
+
+/* Event passed from the input thread to the transaction thread */
+struct txn_event {
+    timing_t timestamp; /* First edge of the press */
+    uint8_t event; /* EV_UP ... EV_C100, EV_VEND_DONE */
+    uint8_t arg; /* Product of EV_VEND_DONE */
+};
+
+K_MSGQ_DEFINE(txn_msgq, sizeof(struct txn_event), TXN_QUEUE_LEN, 4);
+K_THREAD_STACK_DEFINE(input_stack, INPUT_STACK_SIZE);
+static struct k_thread input_thread_data; /* Input thread, started by main */
+
+/* Event generated by the press of each pin */
+static const uint8_t pin_to_event[32] = {
+    [BOARDBUT1] = EV_UP,
+    [BOARDBUT2] = EV_DOWN,
+    [BOARDBUT3] = EV_SELECT,
+    [BOARDBUT4] = EV_RETURN,
+    [BOARDBUT5] = EV_C10,
+    [BOARDBUT6] = EV_C20,
+    [BOARDBUT7] = EV_C50,
+    [BOARDBUT8] = EV_C100,
+};
+
+#ifdef CONFIG_APP_DISPATCH_STATS
+static uint32_t wakeups=0; /* Number of times the input thread has been woken up */
+static uint64_t max_latency_ns=0; /* Worst press-to-output latency observed */
+static uint64_t total_latency_ns=0; /* Sum of the press-to-output latencies */
+static uint32_t latencies=0; /* Presses in total_latency_ns */
+static uint64_t max_isr_ns=0; /* Worst duration of buttons_cbfunction */
+#endif
+
+/**
+ * @brief buttons_cbfunction function run ISR for all the buttons
+ *
+ * buttons_cbfunction is the service routine
+ * related to the interrupt of every button.
+ * The edges are passed to the debounce, which
+ * calls button_pressed once a press is stable.
+ *
+ * @param dev GPIO device that raised the interrupt
+ * @param cb callback structure (buttons_cb_data)
+ * @param pins mask of the pins that triggered
+ */
+
+static void buttons_cbfunction(const struct device *dev, struct gpio_callback *cb, gpio_port_pins_t pins){
+#ifdef CONFIG_APP_DISPATCH_STATS
+    timing_t isr_start = timing_counter_get();
+#endif
+
+    power_edge();
+    trace_edges(pins & BUTTONS_MASK);
+    debounce_edge(pins & BUTTONS_MASK);
 
+#ifdef CONFIG_APP_DISPATCH_STATS
+    timing_t isr_end = timing_counter_get();
+    uint64_t isr_ns = timing_cycles_to_ns(timing_cycles_get(&isr_start, &isr_end));
+    if(isr_ns > max_isr_ns){
+        max_isr_ns = isr_ns;
+    }
+#endif
+}
 
 /**
- * @brief but1press_cbfunction function run ISR for browse up
+ * @brief button_pressed function queue a stable press
  *
- * but1press_cbfunction is the service
- * routine related to the interrupt
- * for browsing up. It just change
- * the state of the volatile "up" variable
- * 
+ * button_pressed is called by the debounce
+ * timer ISR. The press is queued as an input
+ * with the time of its first edge, then the
+ * input thread is woken up. The event
+ * of each input is found by pin_to_event when
+ * it is handled.
+ *
+ * @param pin pin that has been pressed
+ * @param first_edge time of the first edge of the press
  */
 
-void but1press_cbfunction(){
-    //printk("UP product\n"); // button 1 hit !    
-    up = 1;
+static void button_pressed(gpio_pin_t pin, timing_t first_edge){
+    trace_input(pin, TRACE_PRESS);
+    input_ring_put(pin, first_edge);
+    k_sem_give(&input_sem);
 }
 
+
 /**
- * @brief but2press_cbfunction function run ISR for browse down
+ * @brief input_thread function pass the presses to the transaction thread
+ *
+ * Parks the machine when no press comes for
+ * POWER_PARK_TIMEOUT_MS. If the transaction
+ * thread falls behind by TXN_QUEUE_LEN events,
+ * the presses wait in the input ring.
  *
- * but2press_cbfunction is the service
- * routine related to the interrupt
- * for browsing down. It just change
- * the state of the volatile "down" variable
- * 
  */
 
-void but2press_cbfunction(){
-    //printk("DOWN product\n"); // button 2 hit !    
-    down = 1;
+static void input_thread(void *p1, void *p2, void *p3){
+    struct input_event ev;
+    struct txn_event msg;
+
+    while(1){
+#ifdef CONFIG_APP_DISPATCH_POLL
+        /* The loop the dispatcher replaced, kept to measure it */
+        k_msleep(DISPATCH_POLL_MS);
+#else
+        /* Block until an ISR posts an input, no polling while idle */
+        if(k_sem_take(&input_sem, K_MSEC(POWER_PARK_TIMEOUT_MS)) != 0){
+            /* No input for a while, park until the next press */
+            power_park();
+            k_sem_take(&input_sem, K_FOREVER);
+            power_unpark();
+        }
+#endif
+#ifdef CONFIG_APP_DISPATCH_STATS
+        wakeups++;
+#endif
+
+        /* Forward every queued press, in arrival order */
+        while(input_ring_get(&ev)){
+            msg.timestamp = ev.timestamp;
+            msg.event = pin_to_event[ev.pin];
+            k_msgq_put(&txn_msgq, &msg, K_FOREVER);
+        }
+    }
 }
 
+#ifdef CONFIG_APP_LOADGEN
 /**
- * @brief but3press_cbfunction function run ISR for changing product
+ * @brief vending_press function queue a press as the debounce ISR does
  *
- * but3press_cbfunction is the service
- * routine related to the interrupt
- * for changing product. It just modify
- * the state of the volatile "select" variable
- * 
+ * Must be called with the interrupts locked,
+ * the ring has a single producer context.
+ * Used by the burst of the load generator.
+ *
+ * @param pin pin that has been pressed
+ * @return true if the press was stored, false if the ring was full
  */
 
-void but3press_cbfunction(){
-    //printk("PRODUCT SELECTED\n"); // button 3 hit !    
-    select = 1;
+bool vending_press(uint8_t pin){
+    bool stored;
+
+    trace_input(pin, TRACE_PRESS);
+    stored = input_ring_put(pin, timing_counter_get());
+    k_sem_give(&input_sem);
+    return stored;
 }
+#endif
 
 /**
- * @brief but4press_cbfunction function run ISR for returning credit
+ * @brief vending_pending function count the presses not yet handled
  *
- * but4press_cbfunction is the service
- * routine related to the interrupt
- * for returning credit. It just modify
- * the state of the volatile "c_return" variable
- * 
+ * @return events waiting for the transaction thread
  */
 
-void but4press_cbfunction(){
-    //printk("RETURNING REQUEST ACTIVATED\n"); // button 4 hit !    
-    c_return = 1;
+uint32_t vending_pending(void){
+    return k_msgq_num_used_get(&txn_msgq);
 }
 
 /**
- * @brief but5press_cbfunction function run ISR for insert 10 cents
+ * @brief vending_inject function press a button without the hardware
  *
- * but5press_cbfunction is the service
- * routine related to the interrupt
- * for increment the credit of 10 cents. 
- * It just modify he state of the 
- * volatile "c10" variable
- * 
+ * The press goes to the transaction thread
+ * like a debounced one, and waits if the
+ * queue is full. Called by the command channel.
+ *
+ * @param button 1 to 8 for BUT1 to BUT8, VENDING_QUERY for the state,
+ * VENDING_RESET to clear the latency statistics
+ * @return 0, or -EINVAL for an unknown button
  */
 
-void but5press_cbfunction(){
-    //printk("10cent inserted\n"); // button 4 hit !    
-    c10 = 1;
+int vending_inject(uint8_t button){
+    struct txn_event msg;
+
+    if(button > ARRAY_SIZE(vending_button_pins) && button != VENDING_RESET){
+        return -EINVAL;
+    }
+    msg.timestamp = timing_counter_get();
+    if(button == VENDING_QUERY){
+        msg.event = EV_QUERY;
+    }
+    else if(button == VENDING_RESET){
+        msg.event = EV_RESET;
+    }
+    else{
+        trace_input(vending_button_pins[button - 1], TRACE_CMD);
+        msg.event = pin_to_event[vending_button_pins[button - 1]];
+    }
+    k_msgq_put(&txn_msgq, &msg, K_FOREVER);
+    /* Activity for the parking timeout of the input thread */
+    k_sem_give(&input_sem);
+    return 0;
 }
 
 /**
- * @brief but6press_cbfunction function run ISR for insert 20 cents
+ * @brief report_state function print the state of the machine
  *
- * but6press_cbfunction is the service
- * routine related to the interrupt
- * for increment the credit of 20 cents. 
- * It just modify he state of the 
- * volatile "c20" variable
- * 
  */
 
-void but6press_cbfunction(){
-    //printk("20 cent inserted\n"); // button 4 hit !    
-    c20 = 1;
+static void report_state(void){
+    applog_put(APPLOG_STATE, vm.fsm.current, vm.credit);
+    applog_put(APPLOG_PRODUCT, vm.sel_prod, vm.credit);
+    applog_put(APPLOG_EXACT_CHANGE, vm.sel_prod, change_exact_only(&vm.tubes));
 }
 
 /**
- * @brief but5press_cbfunction function run ISR for insert 50 cents
+ * @brief vending_totals_get function read the totals of the machine
  *
- * but7press_cbfunction is the service
- * routine related to the interrupt
- * for increment the credit of 50 cents. 
- * It just modify he state of the 
- * volatile "c50" variable
- * 
+ * Inserted money is always equal to the
+ * current credit plus spent and returned
+ * money.
+ *
+ * @param out where the totals are copied
  */
 
-void but7press_cbfunction(){
-    //printk("50cent inserted\n"); // button 4 hit !    
-    c50 = 1;
+void vending_totals_get(struct vending_totals *out){
+    machine_totals_get(&vm, out);
 }
 
+#ifdef CONFIG_APP_DISPATCH_STATS
 /**
- * @brief but8press_cbfunction function run ISR for insert 1 EUR
+ * @brief vending_dispatch_report function print the cost of the input path
  *
- * but8press_cbfunction is the service
- * routine related to the interrupt
- * for increment the credit of 1 EUR. 
- * It just modify he state of the 
- * volatile "c100" variable
- * 
  */
 
-void but8press_cbfunction(){
-    //printk("1 euro inserted \n"); // button 4 hit !    
-    c100 = 1;
+void vending_dispatch_report(void){
+    uint32_t fsm_last_ns, fsm_max_ns;
+
+    fsm_timing_get(&vm.fsm, &fsm_last_ns, &fsm_max_ns);
+    printk("Dispatch (%s): %u wakeups in %u s, max ISR %u ns\n",
+           IS_ENABLED(CONFIG_APP_DISPATCH_POLL) ? "poll" : "block", wakeups,
+           (uint32_t)(k_uptime_get()/1000), (uint32_t)max_isr_ns);
+    printk("Latency: %u presses, avg %u us, max %u us\n", latencies,
+           latencies ? (uint32_t)(total_latency_ns/latencies/1000) : 0,
+           (uint32_t)(max_latency_ns/1000));
+    printk("Transitions: %u, last dispatch %u ns, max %u ns\n", vm.fsm.transitions,
+           fsm_last_ns, fsm_max_ns);
+}
+#endif
+
+/**
+ * @brief save_state function hand the machine state to the storage
+ *
+ * Called after every change of credit, stock,
+ * tubes or totals; the flash write is
+ * deferred and coalesced by persist.c
+ *
+ */
+
+static void save_state(void){
+    struct persist_state state;
+
+    /* Padding included, or NVS would see a new record every time */
+    memset(&state, 0, sizeof(state));
+    state.credit = vm.credit;
+    for(int i = 0; i < CATALOG_SIZE; i++){
+        state.stock[i] = catalog_stock(&vm.catalog, i + 1);
+    }
+    change_tubes_get(&vm.tubes, state.tubes);
+    vending_totals_get(&state.totals);
+    memcpy(state.owed, owed, sizeof(state.owed));
+    state.journal_seq = journal_last_seq();
+    persist_update(&state);
+}
+
+/**
+ * @brief replay_record function apply a journal record newer than the snapshot
+ *
+ * @param rec record to apply
+ */
+
+static void replay_record(const struct journal_record *rec){
+    switch(rec->type){
+    case JOURNAL_COIN_IN:
+        vm.totals.inserted += rec->amount;
+        change_coin_in(&vm.tubes, rec->amount);
+        break;
+    case JOURNAL_VEND:
+        catalog_take(&vm.catalog, rec->product);
+        vm.totals.spent += rec->amount;
+        vm.totals.vends++;
+        break;
+    case JOURNAL_VEND_FAILED:
+        vm.totals.failed++;
+        break;
+    case JOURNAL_REFUND:
+        change_take(&vm.tubes, &rec->coins);
+        vm.totals.returned += rec->amount;
+        break;
+    }
+    if(rec->product >= 1 && rec->product <= CATALOG_SIZE){
+        if(rec->type == JOURNAL_VEND){
+            owed[rec->product - 1]++;
+        }
+        else if(rec->type == JOURNAL_VENDED && owed[rec->product - 1] > 0){
+            owed[rec->product - 1]--;
+        }
+    }
+    machine_set_credit(&vm, rec->credit);
+}
+
+/**
+ * @brief restore_state function resume from the snapshot and the journal
+ *
+ */
+
+static void restore_state(void){
+    struct persist_state state;
+    int ret = persist_init(&state);
+
+    if(ret == 0){
+        catalog_restore(&vm.catalog, state.stock);
+        change_tubes_set(&vm.tubes, state.tubes);
+        vm.totals = state.totals;
+        memcpy(owed, state.owed, sizeof(owed));
+        machine_set_credit(&vm, state.credit);
+    }
+    else if(ret != -ENOENT){
+        printk("Error %d: Storage not available, state will not be saved\n", ret);
+        return;
+    }
+
+    ret = journal_init(ret == 0 ? state.journal_seq : 0, replay_record);
+    if(ret == -EILSEQ){
+        /* The snapshot taken below marks the records skipped as included */
+        printk("Error: Journal records missing, restored state is incomplete\n");
+    }
+    else if(ret != 0){
+        printk("Error %d: Journal not available\n", ret);
+    }
+    /* New snapshot before the journal compacts anything */
+    save_state();
+    printk("State restored, credit %d\n", vm.credit);
+}
+
+/**
+ * @brief board_log function queue a message of the machine for the log thread
+ *
+ * @param m machine
+ * @param id message id (APPLOG_xxx)
+ * @param product product the message refers to
+ * @param credit credit or amount in cents
+ */
+
+static void board_log(struct machine *m, uint8_t id, int16_t product, int32_t credit){
+    applog_put(id, product, credit);
+}
+
+/**
+ * @brief board_record function count, journal and save a change of the machine
+ *
+ * @param m machine
+ * @param type MACHINE_COIN_IN ... MACHINE_VENDED, same as JOURNAL_xxx
+ * @param product selected product
+ * @param amount coin, price or refund in cents
+ * @param coins coins paid by a refund, NULL otherwise
+ */
+
+BUILD_ASSERT(MACHINE_COIN_IN == JOURNAL_COIN_IN && MACHINE_VEND == JOURNAL_VEND &&
+             MACHINE_VEND_FAILED == JOURNAL_VEND_FAILED && MACHINE_REFUND == JOURNAL_REFUND &&
+             MACHINE_VENDED == JOURNAL_VENDED);
+
+static void board_record(struct machine *m, uint8_t type, int16_t product, int amount,
+                         const struct change_coins *coins){
+    bool journaled;
+
+    switch(type){
+    case MACHINE_COIN_IN:
+        telemetry_coin(amount);
+        break;
+    case MACHINE_VEND:
+        telemetry_vend(product, amount);
+        owed[product - 1]++;
+        break;
+    case MACHINE_VENDED:
+        owed[product - 1] -= owed[product - 1] > 0;
+        break;
+    case MACHINE_VEND_FAILED:
+        /* A busy dispenser is not a refused sale */
+        if(catalog_stock(&m->catalog, product)==0 || !catalog_affordable(&m->catalog, product)){
+            telemetry_refused(catalog_stock(&m->catalog, product)==0);
+        }
+        break;
+    case MACHINE_REFUND:
+        telemetry_refund(amount);
+        break;
+    }
+    /* Appended first: the snapshot names the last record it includes */
+    journaled = journal_append(type, product, amount, m->credit, coins) == 0;
+    save_state();
+    if(!journaled){
+        /* Counted by the journal; the snapshot is the only copy, write it now */
+        persist_flush();
+    }
+}
+
+/**
+ * @brief board_vend function queue a sold product on the dispenser
+ *
+ * @param m machine
+ * @param product product sold
+ */
+
+static void board_vend(struct machine *m, uint8_t product){
+    dispenser_submit(product);
 }
 
+/**
+ * @brief board_busy function check the dispenser queue
+ *
+ * @param m machine
+ * @return true if the dispenser queue is full
+ */
+
+static bool board_busy(struct machine *m){
+    return dispenser_full();
+}
+
+/* Hooks of the board machine */
+static const struct machine_ops board_ops = {
+    .log = board_log,
+    .record = board_record,
+    .vend = board_vend,
+    .busy = board_busy,
+};
+
+/**
+ * @brief vend_done function pass a completed vend to the transaction thread
+ *
+ * Runs on the system workqueue, so it never
+ * waits: with the queue full the dispenser
+ * calls it again later.
+ *
+ * @param product product dropped
+ * @return false if the transaction queue is full
+ */
+
+static bool vend_done(uint8_t product){
+    struct txn_event msg;
+
+    msg.timestamp = timing_counter_get();
+    msg.event = EV_VEND_DONE;
+    msg.arg = product;
+    return k_msgq_put(&txn_msgq, &msg, K_NO_WAIT) == 0;
+}
+
+/**
+ * @brief redispense function vend again the products sold before a reset
+ *
+ * A sale is journaled when it is charged and
+ * its drop when the dispenser confirms it; the
+ * products in between were paid and never
+ * delivered.
+ *
+ */
+
+static void redispense(void){
+    for(int i = 0; i < CATALOG_SIZE; i++){
+        for(int n = 0; n < owed[i]; n++){
+            if(!dispenser_submit(i + 1)){
+                printk("Error: Dispenser full, product %d owed %d times\n", i + 1, owed[i] - n);
+                return;
+            }
+            printk("Product %d sold before the reset, dispensed again\n", i + 1);
+        }
+    }
+}
 
 /**
  * @brief main function run the state machine
@@ -236,240 +573,85 @@ void main(void) {
     
     //configuring buttons
     
-    ret = gpio_pin_configure(gpio0_dev, BOARDBUT1, GPIO_INPUT | GPIO_PULL_UP);
-    if (ret < 0) {
-        printk("Error %d: Failed to configure BUT 1 \n\r", ret);
-	return;
-    }
-    ret = gpio_pin_configure(gpio0_dev, BOARDBUT2, GPIO_INPUT | GPIO_PULL_UP);
-    if (ret < 0) {
-        printk("Error %d: Failed to configure BUT 2 \n\r", ret);
-	return;
+    timing_init();
+    timing_start();
+#ifdef CONFIG_APP_UART_TX_ASYNC
+    uart_tx_init();
+#endif
+    debounce_init(gpio0_dev, button_pressed);
+
+    for (int i = 0; i < ARRAY_SIZE(vending_button_pins); i++) {
+        debounce_set_window(vending_button_pins[i], button_debounce_ms[i]);
+        ret = gpio_pin_configure(gpio0_dev, vending_button_pins[i], GPIO_INPUT | GPIO_PULL_UP);
+        if (ret < 0) {
+            printk("Error %d: Failed to configure BUT %d \n\r", ret, i + 1);
+            return;
+        }
+        /* Set interrupt HW - which pin and event generate interrupt */
+        ret = gpio_pin_interrupt_configure(gpio0_dev, vending_button_pins[i], GPIO_INT_EDGE_TO_ACTIVE);
+        if (ret < 0) {
+            printk("Error %d: Failed to configure interrupt of BUT %d \n\r", ret, i + 1);
+            return;
+        }
     }
-    ret = gpio_pin_configure(gpio0_dev, BOARDBUT3, GPIO_INPUT | GPIO_PULL_UP);
-    if (ret < 0) {
-        printk("Error %d: Failed to configure BUT 3 \n\r", ret);
-	return;
+
+    /* A single callback serves all the buttons */
+    gpio_init_callback(&buttons_cb_data, buttons_cbfunction, BUTTONS_MASK);
+    gpio_add_callback(gpio0_dev, &buttons_cb_data);
+#ifdef CONFIG_APP_COIN_PULSE
+    /* Coins of the pulse line are queued like the presses of BUT5 ... BUT8 */
+    coin_pulse_init(gpio0_dev, button_pressed);
+#endif
+    
+    struct txn_event msg; /* Event being dispatched */
+
+    catalog_init();
+    change_init();
+    machine_init(&vm, &board_ops, NULL);
+    restore_state();
+    dispenser_init(vend_done);
+    redispense();
+    power_init();
+
+    k_thread_create(&input_thread_data, input_stack, K_THREAD_STACK_SIZEOF(input_stack),
+                    input_thread, NULL, NULL, NULL, INPUT_PRIORITY, 0, K_NO_WAIT);
+    k_thread_name_set(&input_thread_data, "input");
+
+    /* From here main is the transaction thread, the only owner of credit, catalog and tubes */
+    while(1){
+    k_msgq_get(&txn_msgq, &msg, K_FOREVER);
+    if(msg.event == EV_QUERY){
+        report_state();
+        continue;
     }
-    ret = gpio_pin_configure(gpio0_dev, BOARDBUT4, GPIO_INPUT | GPIO_PULL_UP);
-    if (ret < 0) {
-        printk("Error %d: Failed to configure BUT 4 \n\r", ret);
-	return;
+    if(msg.event == EV_RESET){
+        /* Here, as the samples are recorded by this thread */
+        latency_reset();
+#ifdef CONFIG_APP_DISPATCH_STATS
+        max_latency_ns = 0;
+        total_latency_ns = 0;
+        latencies = 0;
+#endif
+        continue;
     }
-  
-  ret = gpio_pin_configure(gpio0_dev, BOARDBUT5, GPIO_INPUT | GPIO_PULL_UP);
-    if (ret < 0) {
-        printk("Error %d: Failed to configure BUT 5 \n\r", ret);
-	return;
+    timing_t started = timing_counter_get();
+    if(msg.event == EV_VEND_DONE){
+        machine_vend_done(&vm, msg.arg);
     }
-    ret = gpio_pin_configure(gpio0_dev, BOARDBUT6, GPIO_INPUT | GPIO_PULL_UP);
-    if (ret < 0) {
-        printk("Error %d: Failed to configure BUT 6 \n\r", ret);
-	return;
+    else{
+        machine_step(&vm, msg.event);
     }
-    ret = gpio_pin_configure(gpio0_dev, BOARDBUT7, GPIO_INPUT | GPIO_PULL_UP);
-    if (ret < 0) {
-        printk("Error %d: Failed to configure BUT 7 \n\r", ret);
-	return;
+    latency_handled(msg.event, started);
+    latency_record(msg.event, msg.timestamp);
+#ifdef CONFIG_APP_DISPATCH_STATS
+    timing_t now = timing_counter_get();
+    uint64_t latency_ns = timing_cycles_to_ns(timing_cycles_get(&msg.timestamp, &now));
+    if(latency_ns > max_latency_ns){
+        max_latency_ns = latency_ns;
     }
-    ret = gpio_pin_configure(gpio0_dev, BOARDBUT8, GPIO_INPUT | GPIO_PULL_UP);
-    if (ret < 0) {
-        printk("Error %d: Failed to configure BUT 8 \n\r", ret);
-	return;
-    }
-  
-    /* Set interrupt HW - which pin and event generate interrupt */
-    ret = gpio_pin_interrupt_configure(gpio0_dev, BOARDBUT1, GPIO_INT_EDGE_TO_ACTIVE);
-    gpio_init_callback(&but1_cb_data, but1press_cbfunction, BIT(BOARDBUT1));
-    gpio_add_callback(gpio0_dev, &but1_cb_data);
-
-    ret = gpio_pin_interrupt_configure(gpio0_dev, BOARDBUT2, GPIO_INT_EDGE_TO_ACTIVE);
-    gpio_init_callback(&but2_cb_data, but2press_cbfunction, BIT(BOARDBUT2));
-    gpio_add_callback(gpio0_dev, &but2_cb_data);
-
-    ret = gpio_pin_interrupt_configure(gpio0_dev, BOARDBUT3, GPIO_INT_EDGE_TO_ACTIVE);
-    gpio_init_callback(&but3_cb_data, but3press_cbfunction, BIT(BOARDBUT3));
-    gpio_add_callback(gpio0_dev, &but3_cb_data);
-
-    ret = gpio_pin_interrupt_configure(gpio0_dev, BOARDBUT4, GPIO_INT_EDGE_TO_ACTIVE);
-    gpio_init_callback(&but4_cb_data, but4press_cbfunction, BIT(BOARDBUT4));
-    gpio_add_callback(gpio0_dev, &but4_cb_data);
-    
-    ret = gpio_pin_interrupt_configure(gpio0_dev, BOARDBUT5, GPIO_INT_EDGE_TO_ACTIVE);
-    gpio_init_callback(&but5_cb_data, but5press_cbfunction, BIT(BOARDBUT5));
-    gpio_add_callback(gpio0_dev, &but5_cb_data);
-
-    ret = gpio_pin_interrupt_configure(gpio0_dev, BOARDBUT6, GPIO_INT_EDGE_TO_ACTIVE);
-    gpio_init_callback(&but6_cb_data, but6press_cbfunction, BIT(BOARDBUT6));
-    gpio_add_callback(gpio0_dev, &but6_cb_data);
-
-    ret = gpio_pin_interrupt_configure(gpio0_dev, BOARDBUT7, GPIO_INT_EDGE_TO_ACTIVE);
-    gpio_init_callback(&but7_cb_data, but7press_cbfunction, BIT(BOARDBUT7));
-    gpio_add_callback(gpio0_dev, &but7_cb_data);
-
-    ret = gpio_pin_interrupt_configure(gpio0_dev, BOARDBUT8, GPIO_INT_EDGE_TO_ACTIVE);
-    gpio_init_callback(&but8_cb_data, but8press_cbfunction, BIT(BOARDBUT8));
-    gpio_add_callback(gpio0_dev, &but8_cb_data);
-    
-    int state=IDLE;
-  
-      while(1){
-    switch(state){
-      case IDLE:
-        if(up==1) { state=BROWSE_UP; }
-        if(down==1) { state=BROWSE_DOWN; }
-        if(select==1) { state=DISPENSING; }
-        if(c10==1) {state=CENT10; }
-        if(c20==1) {state=CENT20; }
-        if(c50==1) {state=CENT50; }
-        if(c100==1) {state=CENT100; }
-        if(c_return==1) { state=RETURNING; }
-      break;
-      
-      case BROWSE_UP:
-        up=0;
-        if(sel_prod<3){
-            sel_prod=sel_prod+1;
-        }
-        /*Print the product and */
-        if(sel_prod==1){
-    	printk("Beer: 1.50 EUR\n");
-  	}
-  	else if(sel_prod==2){
-    	printk("Tuna sandwitch: 1.00 EUR\n");
-  	}
-  	else if(sel_prod==3){
-    	printk("Coffee: 0.50 EUR\n");
-  	}
-	printk("Credit: %d.%d EUR\n",credit/100,credit%100);
-        state=IDLE;
-      break;
-
-      case BROWSE_DOWN:
-      	down=0;
-        if(sel_prod>1){
-            sel_prod=sel_prod-1;
-        }
-        /*Print the product and */
-        if(sel_prod==1){
-    	printk("Beer: 1.50 EUR\n");
-  	}
-  	else if(sel_prod==2){
-    	printk("Tuna sandwitch: 1.00 EUR\n");
-  	}
-  	else if(sel_prod==3){
-    	printk("Coffee: 0.50 EUR\n");
-  	}
-  	printk("Credit: %d.%d EUR\n",credit/100,credit%100);
-        state=IDLE;
-      break;
-
-      case DISPENSING:
-        select=0;
-        dispensing_superstate();
-        state=IDLE;
-      break;
-
-      case CENT10:
-      	c10=0;
-      	credit=credit+10;
-      	printk("Credit: %d.%d EUR\n",credit/100,credit%100);
-      	state=IDLE;
-      break;
-      
-      case CENT20:
-      	c20=0;
-      	credit=credit+20;
-      	printk("Credit: %d.%d EUR\n",credit/100,credit%100);
-      	state=IDLE;
-      break;
-      
-      case CENT50:
-      	c50=0;
-      	credit=credit+50;
-      	printk("Credit: %d.%d EUR\n",credit/100,credit%100);
-      	state=IDLE;
-      break;
-      
-      case CENT100:
-      	c100=0;
-      	credit=credit+100;
-      	printk("Credit: %d.%d EUR\n",credit/100,credit%100);
-      	state=IDLE;
-      break;
-
-      case RETURNING:
-      	c_return=0;
-        printk("%d.%d EUR credit return\n",credit/100,credit%100);
-        credit=0;
-        state=IDLE;
-      break;
-      
-      }/*switch(state)*/
-      k_msleep(SLEEP_MS);
+    total_latency_ns += latency_ns;
+    latencies++;
+#endif
     }/*while(1)*/
   return;
 }/*void main(void)*/
-
-
-/**
- * @brief dispensing_superstate implement the dispensing procedure
- *
- * dispensing_superstate is the function
- * that go to implement the inner state
- * machine for dispensing the product
- *
- */
- 
- 
-/*Implementation of Dispesing superstate*/
-void dispensing_superstate(){
-
-  int16_t state1=COMPARISON;
-
-  while(1){
-    switch(state1){
-      case COMPARISON:
-      	if(sel_prod==1 && credit>=beerCost) { state1=OK; }
-      	else if(sel_prod==2 && credit>=tunaSandwichCost) { state1=OK; }
-      	else if(sel_prod==3 && credit>=coffeeCost) { state1=OK; }
-      	else state1=ERROR;
-      break;
-      
-      case ERROR:
-        if(sel_prod==1){ 
-        	printk("Not enough credit, product Beer cost 1.50 EUR, credit is %d.%d EUR\n",credit/100,credit%100);
-  	}
-  	else if(sel_prod==2){
-		printk("Not enough credit, product Tuna sandwich cost 1.00 EUR, credit is %d.%d EUR\n",credit/100,credit%100);
-  	}
-  	else if(sel_prod==3){
-		printk("Not enough credit, product Coffee cost 0.50 EUR, credit is %d.%d EUR\n",credit/100,credit%100);
-  	}
-        state1=DISPENSE;
-      break;
-      
-      case OK:
-        if(sel_prod==1){
-    	  credit=credit-150;
-          printk("Product Beer dispensed, remaining credit %d.%d EUR\n",credit/100,credit%100);
-  	}
-  	else if(sel_prod==2){
-          credit=credit-100;
-    	  printk("Product Tuna Sandwich dispensed, remaining credit %d.%d EUR\n",credit/100,credit%100);
-  	}
-  	else if(sel_prod==3){
-          credit=credit-50;
-    	  printk("Product Coffee dispensed, remaining credit %d.%d EUR\n",credit/100,credit%100);
-  	}
-        state1=DISPENSE;
-      break;
-      
-      case DISPENSE:
-        return;
-      break;
-      }
-     }
-     return;
-}
-    
@@ -0,0 +1,242 @@
+/** @file persist.c
+ * @brief Implementation of the persistent machine state
+ *
+ * The state is kept as a single NVS record on
+ * the storage partition. The state machine only
+ * copies the new state in RAM with
+ * persist_update(); the flash write is done
+ * later by the storage work queue, once no update
+ * came for PERSIST_QUIET_MS or at the latest
+ * PERSIST_MAX_AGE_MS after the first pending
+ * one. A burst of coins therefore costs a single
+ * write, and NVS spreads the writes over its
+ * sectors.
+ *
+ * A failed write leaves the state pending: it
+ * is counted and tried again PERSIST_RETRY_MS
+ * later, or with the next update.
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#include <zephyr.h>
+#include <device.h>
+#include <devicetree.h>
+#include <drivers/flash.h>
+#include <storage/flash_map.h>
+#include <fs/nvs.h>
+#include <timing/timing.h>
+#include <sys/printk.h>
+#include <string.h>
+
+#include "persist.h"
+
+#define PERSIST_ID 1 /* NVS id of the state record */
+#define PERSIST_STACK_SIZE 1024 /* Stack of the storage work queue */
+#define PERSIST_PRIORITY K_LOWEST_APPLICATION_THREAD_PRIO /* Flash waits must not delay the inputs */
+#define PERSIST_ATE_SIZE 8 /* NVS header written with every record */
+
+static void persist_commit(struct k_work *work);
+static int persist_write(void);
+
+K_WORK_DELAYABLE_DEFINE(commit_work, persist_commit);
+K_THREAD_STACK_DEFINE(persist_stack, PERSIST_STACK_SIZE);
+
+struct k_work_q persist_work_q; /* Runs every flash write and erase, journal included */
+
+static struct nvs_fs fs; /* NVS on the storage partition */
+static bool ready=false; /* NVS mounted */
+static struct k_spinlock lock; /* Protects shadow, dirty and first_dirty */
+static struct persist_state shadow; /* Last state given by persist_update() */
+static bool dirty=false; /* shadow not yet written */
+static int64_t first_dirty; /* Uptime of the oldest update not yet written */
+static struct persist_stats stats; /* Counters, see persist_stats_get() */
+
+/**
+ * @brief persist_init function mount the storage and read the saved state
+ *
+ * @param restored where the saved state is copied
+ * @return 0 if a state was restored, negative error code otherwise
+ */
+
+int persist_init(struct persist_state *restored){
+    const struct device *flash_dev = device_get_binding(DT_LABEL(DT_CHOSEN(zephyr_flash_controller)));
+    struct flash_pages_info info;
+    timing_t start = timing_counter_get();
+    timing_t end;
+    const struct k_work_queue_config cfg = { .name = "storage" };
+    int rc;
+
+    k_work_queue_start(&persist_work_q, persist_stack, K_THREAD_STACK_SIZEOF(persist_stack),
+                       PERSIST_PRIORITY, &cfg);
+    if (flash_dev == NULL) {
+        return -ENODEV;
+    }
+    fs.offset = FLASH_AREA_OFFSET(storage);
+    rc = flash_get_page_info_by_offs(flash_dev, fs.offset, &info);
+    if (rc) {
+        return rc;
+    }
+    fs.sector_size = info.size;
+    fs.sector_count = PERSIST_SECTORS;
+    rc = nvs_init(&fs, flash_dev->name);
+    if (rc) {
+        return rc;
+    }
+    ready = true;
+
+    rc = nvs_read(&fs, PERSIST_ID, restored, sizeof(*restored));
+    end = timing_counter_get();
+    stats.recovery_us = (uint32_t)(timing_cycles_to_ns(timing_cycles_get(&start, &end)) / 1000);
+
+    if (rc != sizeof(*restored) || restored->version != PERSIST_VERSION) {
+        return -ENOENT;
+    }
+    shadow = *restored;
+    return 0;
+}
+
+/**
+ * @brief persist_update function give the new state to the storage
+ *
+ * Cheap: the state is copied and the commit
+ * is scheduled, nothing is written here.
+ *
+ * @param state new state
+ */
+
+void persist_update(const struct persist_state *state){
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    int64_t now = k_uptime_get();
+    int64_t delay = PERSIST_QUIET_MS;
+
+    memcpy(&shadow, state, sizeof(shadow));
+    shadow.version = PERSIST_VERSION;
+    if (!dirty) {
+        dirty = true;
+        first_dirty = now;
+    }
+    delay = MIN(delay, MAX(first_dirty + PERSIST_MAX_AGE_MS - now, 0));
+    stats.updates++;
+    k_spin_unlock(&lock, key);
+
+    k_work_reschedule_for_queue(&persist_work_q, &commit_work, K_MSEC(delay));
+}
+
+/**
+ * @brief persist_flush function write the pending state now
+ *
+ */
+
+void persist_flush(void){
+    k_work_reschedule_for_queue(&persist_work_q, &commit_work, K_NO_WAIT);
+}
+
+/**
+ * @brief persist_sync function write the pending state and wait for it
+ *
+ * Must be called from persist_work_q, as
+ * persist_write() is not reentrant.
+ *
+ * @return 0 if the flash holds the last state, negative error code otherwise
+ */
+
+int persist_sync(void){
+    return persist_write();
+}
+
+/**
+ * @brief persist_commit function write the state to flash
+ *
+ * Runs in persist_work_q.
+ *
+ * @param work commit_work
+ */
+
+static void persist_commit(struct k_work *work){
+    persist_write();
+}
+
+/**
+ * @brief persist_write function write the pending state, if any
+ *
+ * On a failure the state is pending again and
+ * the commit is rescheduled.
+ *
+ * @return 0 if the flash holds the last state, negative error code otherwise
+ */
+
+static int persist_write(void){
+    struct persist_state state;
+    k_spinlock_key_t key;
+    timing_t start;
+    timing_t end;
+    ssize_t rc;
+
+    if (!ready) {
+        return -ENODEV;
+    }
+    key = k_spin_lock(&lock);
+    if (!dirty) {
+        k_spin_unlock(&lock, key);
+        return 0;
+    }
+    memcpy(&state, &shadow, sizeof(state));
+    dirty = false;
+    k_spin_unlock(&lock, key);
+
+    start = timing_counter_get();
+    rc = nvs_write(&fs, PERSIST_ID, &state, sizeof(state));
+    end = timing_counter_get();
+
+    if (rc < 0) {
+        key = k_spin_lock(&lock);
+        /* A newer update may be pending already, it supersedes this state */
+        if (!dirty) {
+            dirty = true;
+            first_dirty = k_uptime_get();
+        }
+        stats.errors++;
+        stats.last_error = rc;
+        k_spin_unlock(&lock, key);
+        k_work_reschedule_for_queue(&persist_work_q, &commit_work, K_MSEC(PERSIST_RETRY_MS));
+        return rc;
+    }
+
+    /* 0 means the record was already up to date and nothing was written */
+    if (rc > 0) {
+        stats.commits++;
+        stats.bytes += rc + PERSIST_ATE_SIZE;
+        stats.last_commit_us = (uint32_t)(timing_cycles_to_ns(timing_cycles_get(&start, &end)) / 1000);
+        stats.max_commit_us = MAX(stats.max_commit_us, stats.last_commit_us);
+    }
+    return 0;
+}
+
+/**
+ * @brief persist_stats_get function read the storage counters
+ *
+ * updates / commits is how many state changes
+ * each flash write absorbed.
+ *
+ * @param out where the counters are copied
+ */
+
+void persist_stats_get(struct persist_stats *out){
+    *out = stats;
+}
+
+/**
+ * @brief persist_report function print the storage counters
+ *
+ */
+
+void persist_report(void){
+    printk("Storage: %u updates, %u commits (%u updates per write), %u bytes written\n",
+           stats.updates, stats.commits, stats.updates / MAX(stats.commits, 1), stats.bytes);
+    printk("Commit: last %u us, max %u us, boot recovery %u us\n",
+           stats.last_commit_us, stats.max_commit_us, stats.recovery_us);
+    printk("Errors: %u failed writes, last %d\n", stats.errors, stats.last_error);
+}
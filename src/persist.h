@@ -0,0 +1,56 @@
+/** @file persist.h
+ * @brief Declarations of the persistent machine state
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#ifndef PERSIST_H
+#define PERSIST_H
+
+#include <zephyr.h>
+
+#include "catalog.h"
+#include "change.h"
+#include "vending.h"
+
+#define PERSIST_VERSION 3 /* Bump when struct persist_state changes */
+#define PERSIST_QUIET_MS 500 /* Commit after this time without updates */
+#define PERSIST_MAX_AGE_MS 2000 /* Never keep an update in RAM longer than this */
+#define PERSIST_RETRY_MS 1000 /* Delay before writing again after a failed commit */
+#define PERSIST_SECTORS 2 /* NVS sectors at the start of the storage partition */
+
+/* State that survives a reset, compared byte for byte by NVS: zero it before filling */
+struct persist_state {
+    uint32_t version; /* PERSIST_VERSION */
+    int32_t credit; /* Credit of the customer */
+    uint16_t stock[CATALOG_SIZE]; /* Items left in each slot */
+    uint16_t tubes[CHANGE_N_COINS]; /* Coins held for change */
+    struct vending_totals totals; /* Money and products handled */
+    uint8_t owed[CATALOG_SIZE]; /* Products sold and not yet dropped */
+    uint32_t journal_seq; /* Last journal record included */
+};
+
+/* Counters of the persistent storage */
+struct persist_stats {
+    uint32_t updates; /* Calls to persist_update() */
+    uint32_t commits; /* Writes to flash */
+    uint32_t bytes; /* Bytes written to flash, record headers included */
+    uint32_t last_commit_us; /* Duration of the last commit */
+    uint32_t max_commit_us; /* Worst commit */
+    uint32_t recovery_us; /* Time taken by persist_init() */
+    uint32_t errors; /* Failed writes, retried after PERSIST_RETRY_MS */
+    int32_t last_error; /* Error code of the last failed write */
+};
+
+extern struct k_work_q persist_work_q;
+
+int persist_init(struct persist_state *restored);
+void persist_update(const struct persist_state *state);
+void persist_flush(void);
+int persist_sync(void);
+void persist_stats_get(struct persist_stats *stats);
+void persist_report(void);
+
+#endif /* PERSIST_H */
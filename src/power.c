@@ -0,0 +1,291 @@
+/** @file power.c
+ * @brief Implementation of the idle (parked) mode and power reporting
+ *
+ * When no input arrives for POWER_PARK_TIMEOUT_MS
+ * the machine is parked: the console UART is
+ * suspended, which on the nRF52840 releases the
+ * high frequency clock, the input thread blocks
+ * with no timeout and the log thread stops the
+ * telemetry frames. With no thread ready and no
+ * timer armed the idle thread can stay in the
+ * deepest state allowed by the PM policy until a
+ * button edge arrives.
+ *
+ * With the command channel (CONFIG_APP_UART_CMD)
+ * the RX pin of the console is the wake line:
+ * while the UART is suspended the pin is a GPIO
+ * interrupting on the falling edge of a start
+ * bit. The byte of that start bit is lost, so a
+ * host sends a blank, which the channel ignores,
+ * before its commands. Without an RX pin in the
+ * devicetree (native_posix) the UART stays on.
+ *
+ * The first edge seen while parked resumes the
+ * UART from the system workqueue, so the console
+ * is back while the press is still debounced.
+ *
+ * Time spent active and parked, the number of
+ * wakeups and the wake-to-ready latency are kept,
+ * and with CONFIG_PM also the residency in every
+ * SoC power state entered by the idle thread.
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#include <zephyr.h>
+#include <device.h>
+#include <devicetree.h>
+#include <drivers/gpio.h>
+#include <sys/printk.h>
+#include <timing/timing.h>
+#ifdef CONFIG_PM
+#include <pm/pm.h>
+#endif
+#ifdef CONFIG_PM_DEVICE
+#include <pm/device.h>
+#endif
+
+#include "power.h"
+
+static void power_resume(struct k_work *work);
+
+K_WORK_DEFINE(resume_work, power_resume);
+
+#define POWER_CONSOLE_NODE DT_CHOSEN(zephyr_console)
+
+#if defined(CONFIG_APP_UART_CMD) && DT_NODE_HAS_PROP(POWER_CONSOLE_NODE, rx_pin)
+#define POWER_WAKE_PIN DT_PROP(POWER_CONSOLE_NODE, rx_pin) /* Wake line, P0 only */
+BUILD_ASSERT(POWER_WAKE_PIN < 32, "The RX pin of the console must be on P0");
+#endif
+
+/* The console can be suspended: nothing reads it, or its RX pin wakes the machine */
+#if defined(CONFIG_PM_DEVICE) && (!defined(CONFIG_APP_UART_CMD) || defined(POWER_WAKE_PIN))
+#define POWER_SUSPEND_CONSOLE 1
+#else
+#define POWER_SUSPEND_CONSOLE 0
+#endif
+
+static const struct device *console = DEVICE_DT_GET(POWER_CONSOLE_NODE);
+static atomic_t parked = ATOMIC_INIT(0); /* 1 while the machine is parked */
+static timing_t wake_stamp; /* First edge seen while parked */
+static int64_t mode_start; /* Uptime at the last park or wakeup, in ms */
+static int64_t active_ms=0; /* Time spent active */
+static int64_t parked_ms=0; /* Time spent parked */
+static uint32_t wakeups=0; /* Wakeups from the parked mode */
+static uint32_t wake_last_us=0; /* Last wake-to-ready latency */
+static uint32_t wake_max_us=0; /* Worst wake-to-ready latency */
+static bool console_off=false; /* The console UART is suspended */
+static uint32_t uart_wakeups=0; /* Wakeups from the wake line */
+
+#ifdef POWER_WAKE_PIN
+
+static const struct device *wake_port = DEVICE_DT_GET(DT_NODELABEL(gpio0));
+static struct gpio_callback wake_cb_data; /* Callback of the wake line */
+
+/**
+ * @brief power_wake_line function start bit received while parked
+ *
+ * @param dev GPIO port of the RX pin
+ * @param cb callback structure (wake_cb_data)
+ * @param pins mask of the pins that triggered
+ */
+
+static void power_wake_line(const struct device *dev, struct gpio_callback *cb,
+                            gpio_port_pins_t pins){
+    gpio_pin_interrupt_configure(wake_port, POWER_WAKE_PIN, GPIO_INT_DISABLE);
+    uart_wakeups++;
+    power_edge();
+}
+
+#endif /* POWER_WAKE_PIN */
+#ifdef CONFIG_PM
+
+#define POWER_N_PM_STATES (PM_STATE_SOFT_OFF + 1)
+
+static int64_t pm_entry_ticks; /* Time of the last entry in a SoC power state */
+static int64_t pm_ticks[POWER_N_PM_STATES]; /* Residency of each SoC power state */
+static uint32_t pm_entries[POWER_N_PM_STATES]; /* Entries in each SoC power state */
+
+/* Names of the SoC power states */
+static const char *const pm_names[POWER_N_PM_STATES] = {
+    "active", "runtime-idle", "suspend-to-idle", "standby",
+    "suspend-to-ram", "suspend-to-disk", "soft-off",
+};
+
+static void pm_entry(enum pm_state state){
+    pm_entry_ticks = k_uptime_ticks();
+    pm_entries[state]++;
+}
+
+static void pm_exit(enum pm_state state){
+    pm_ticks[state] += k_uptime_ticks() - pm_entry_ticks;
+}
+
+static struct pm_notifier pm_notifier = {
+    .state_entry = pm_entry,
+    .state_exit = pm_exit,
+};
+
+#endif /* CONFIG_PM */
+
+/**
+ * @brief power_init function start the power accounting
+ *
+ */
+
+void power_init(void){
+    mode_start = k_uptime_get();
+#ifdef POWER_WAKE_PIN
+    gpio_init_callback(&wake_cb_data, power_wake_line, BIT(POWER_WAKE_PIN));
+    gpio_add_callback(wake_port, &wake_cb_data);
+#endif
+#ifdef CONFIG_PM
+    pm_notifier_register(&pm_notifier);
+#endif
+}
+
+/**
+ * @brief power_park function park the machine
+ *
+ * power_park is called by the input thread
+ * after POWER_PARK_TIMEOUT_MS without
+ * inputs, right before it blocks forever.
+ *
+ */
+
+void power_park(void){
+    int64_t now = k_uptime_get();
+
+    active_ms += now - mode_start;
+    mode_start = now;
+#if POWER_SUSPEND_CONSOLE
+    console_off = pm_device_action_run(console, PM_DEVICE_ACTION_SUSPEND) == 0;
+#endif
+#ifdef POWER_WAKE_PIN
+    if (console_off) {
+        gpio_pin_configure(wake_port, POWER_WAKE_PIN, GPIO_INPUT | GPIO_PULL_UP);
+        gpio_pin_interrupt_configure(wake_port, POWER_WAKE_PIN, GPIO_INT_EDGE_FALLING);
+    }
+#endif
+    atomic_set(&parked, 1);
+}
+
+/**
+ * @brief power_parked function tell if the machine is parked
+ *
+ * @return true between power_park and the wakeup
+ */
+
+bool power_parked(void){
+    return atomic_get(&parked) != 0;
+}
+
+/**
+ * @brief power_edge function wake the machine on a button edge
+ *
+ * power_edge is called by the GPIO ISR for
+ * every edge. Only the first edge seen while
+ * parked does something.
+ *
+ */
+
+void power_edge(void){
+    if (atomic_cas(&parked, 1, 0)) {
+        wake_stamp = timing_counter_get();
+        k_work_submit(&resume_work);
+    }
+}
+
+/**
+ * @brief power_wakeup function bring the machine back from the parked mode
+ *
+ */
+
+static void power_wakeup(void){
+    int64_t now = k_uptime_get();
+    timing_t ready;
+
+#if POWER_SUSPEND_CONSOLE
+    if (console_off) {
+#ifdef POWER_WAKE_PIN
+        gpio_pin_interrupt_configure(wake_port, POWER_WAKE_PIN, GPIO_INT_DISABLE);
+#endif
+        /* The UART takes the RX pin back */
+        pm_device_action_run(console, PM_DEVICE_ACTION_RESUME);
+        console_off = false;
+    }
+#endif
+    ready = timing_counter_get();
+
+    parked_ms += now - mode_start;
+    mode_start = now;
+    wakeups++;
+    wake_last_us = (uint32_t)(timing_cycles_to_ns(timing_cycles_get(&wake_stamp, &ready)) / 1000);
+    wake_max_us = MAX(wake_max_us, wake_last_us);
+}
+
+/**
+ * @brief power_resume function wake up from the system workqueue
+ *
+ * @param work resume_work
+ */
+
+static void power_resume(struct k_work *work){
+    power_wakeup();
+}
+
+/**
+ * @brief power_unpark function make sure the machine is awake
+ *
+ * power_unpark is called by the input thread
+ * when it gets an input after power_park.
+ * Normally the first edge has already resumed
+ * the machine; this covers an edge that came
+ * while power_park was running.
+ *
+ */
+
+void power_unpark(void){
+    if (atomic_cas(&parked, 1, 0)) {
+        wake_stamp = timing_counter_get();
+        power_wakeup();
+    }
+}
+
+/**
+ * @brief power_report function print the power figures
+ *
+ * Prints the time spent active and parked, the
+ * wakeups per hour, the wake-to-ready latency,
+ * what parking does to the console and, with
+ * CONFIG_PM, the SoC power states.
+ *
+ */
+
+void power_report(void){
+    int64_t now = k_uptime_get();
+    int64_t active = active_ms + (atomic_get(&parked) ? 0 : now - mode_start);
+    int64_t park = parked_ms + (atomic_get(&parked) ? now - mode_start : 0);
+
+    printk("Active: %u ms, parked: %u ms\n", (uint32_t)active, (uint32_t)park);
+    printk("Wakeups: %u (%u per hour), wake to ready: %u us, max %u us\n", wakeups,
+           (uint32_t)((uint64_t)wakeups * 3600000 / MAX(now, 1)), wake_last_us, wake_max_us);
+#ifdef POWER_WAKE_PIN
+    printk("Parked: console suspended, %u wakeups from RX pin %d\n", uart_wakeups,
+           POWER_WAKE_PIN);
+#elif POWER_SUSPEND_CONSOLE
+    printk("Parked: console suspended\n");
+#else
+    printk("Parked: console kept on, parking only stops the telemetry\n");
+#endif
+#ifdef CONFIG_PM
+    for (int i = 0; i < POWER_N_PM_STATES; i++) {
+        if (pm_entries[i] != 0) {
+            printk("%s: %u entries, %u ms\n", pm_names[i], pm_entries[i],
+                   (uint32_t)k_ticks_to_ms_floor64(pm_ticks[i]));
+        }
+    }
+#endif
+}
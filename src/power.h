@@ -0,0 +1,23 @@
+/** @file power.h
+ * @brief Declarations of the idle (parked) mode and power reporting
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#ifndef POWER_H
+#define POWER_H
+
+#include <zephyr.h>
+
+#define POWER_PARK_TIMEOUT_MS 30000 /* Inactivity before the machine is parked */
+
+void power_init(void);
+void power_park(void);
+void power_edge(void);
+bool power_parked(void);
+void power_unpark(void);
+void power_report(void);
+
+#endif /* POWER_H */
@@ -0,0 +1,169 @@
+/** @file replay.c
+ * @brief Replay of a recorded input trace
+ *
+ * Feeds the presses of src/trace_data.h, made
+ * with tools/trace2c.py from a trace dumped on
+ * the console, to a machine of its own, on the
+ * board or on native_posix. The machine starts
+ * from machine_init() every run, full slots and
+ * tubes and no credit, whatever the board
+ * machine restored from flash, so every run of a
+ * trace takes the same paths. The gaps between
+ * presses are divided by
+ * CONFIG_APP_TRACE_REPLAY_SPEEDUP, 0 sends them
+ * back to back. At the end the handling time of
+ * every press and the average and worst of every
+ * input are printed, so the same trace is a
+ * performance benchmark.
+ *
+ * The presses are stepped straight into the
+ * machine, with interrupts locked: the button
+ * ISR, the debounce and the threads of the board
+ * are not part of the replay. A product sold is
+ * dropped at once, as a dispenser would.
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#include <zephyr.h>
+#include <sys/printk.h>
+#include <timing/timing.h>
+#ifdef CONFIG_ARCH_POSIX
+#include <posix_board_if.h>
+#endif
+
+#include "latency.h"
+#include "machine.h"
+#include "trace.h"
+#include "vending.h"
+
+#include "trace_data.h"
+
+#define REPLAY_STACK_SIZE 1024 /* Stack of the replayer, the report uses printk */
+#define REPLAY_PRIORITY 7 /* Below the transaction thread, above the log thread */
+#define REPLAY_START_MS 100 /* Time given to main() to build the catalog and change tables */
+
+static void replay_vend(struct machine *m, uint8_t product);
+
+/* Only the dispenser is modeled */
+static const struct machine_ops replay_ops = {
+    .vend = replay_vend,
+};
+
+static struct machine rm; /* Machine of the replay, not the one of the board */
+static uint8_t sold; /* Product handed to the dispenser by the last press, 0 if none */
+static uint32_t handling_ns[ARRAY_SIZE(trace_data)]; /* Handling time of every press */
+static struct latency_handling inputs[LATENCY_N_INPUTS]; /* Average and worst of every input */
+
+/**
+ * @brief replay_vend function take a sold product
+ *
+ * @param m replay machine
+ * @param product product sold
+ */
+
+static void replay_vend(struct machine *m, uint8_t product){
+    sold = product;
+}
+
+/**
+ * @brief replay_button function return the button of a pin
+ *
+ * @param pin pin of the trace
+ * @return 1 to 8, 0 if the pin is not a button
+ */
+
+static uint8_t replay_button(uint8_t pin){
+    for (int i = 0; i < VENDING_BUTTONS; i++) {
+        if (vending_button_pins[i] == pin) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief replay_press function step a press and time it
+ *
+ * @param button 1 to 8
+ * @return handling time of the press in ns
+ */
+
+static uint32_t replay_press(uint8_t button){
+    uint8_t input = button - 1; /* EV_UP ... EV_C100 */
+    timing_t start, end;
+    unsigned int key;
+    uint32_t ns;
+
+    key = irq_lock();
+    start = timing_counter_get();
+    machine_step(&rm, input);
+    end = timing_counter_get();
+    irq_unlock(key);
+    ns = (uint32_t)timing_cycles_to_ns(timing_cycles_get(&start, &end));
+
+    if (sold != 0) {
+        machine_vend_done(&rm, sold);
+        sold = 0;
+    }
+    inputs[input].count++;
+    inputs[input].total_ns += ns;
+    inputs[input].max_ns = MAX(inputs[input].max_ns, ns);
+    return ns;
+}
+
+/**
+ * @brief replay_thread function replay the trace and print the timings
+ *
+ */
+
+static void replay_thread(void){
+    int64_t start;
+    uint32_t elapsed_ms;
+
+    machine_init(&rm, &replay_ops, NULL);
+    rm.fsm.timed = false;
+    printk("Replay: %u presses, speedup %u\n", (uint32_t)ARRAY_SIZE(trace_data),
+           CONFIG_APP_TRACE_REPLAY_SPEEDUP);
+    start = k_uptime_get();
+
+    for (int i = 0; i < ARRAY_SIZE(trace_data); i++) {
+        uint8_t button = replay_button(trace_data[i].pin);
+
+        if (CONFIG_APP_TRACE_REPLAY_SPEEDUP > 0 && i > 0) {
+            k_usleep((trace_data[i].us - trace_data[i - 1].us) / CONFIG_APP_TRACE_REPLAY_SPEEDUP);
+        }
+        if (button != 0) {
+            handling_ns[i] = replay_press(button);
+        }
+    }
+    elapsed_ms = (uint32_t)(k_uptime_get() - start);
+
+    printk("Replay done in %u ms, credit %d, %u vends\n", elapsed_ms, rm.credit,
+           rm.totals.vends);
+    for (int i = 0; i < ARRAY_SIZE(trace_data); i++) {
+        uint8_t button = replay_button(trace_data[i].pin);
+
+        if (button != 0) {
+            printk("%4d %10u us %-6s %u ns\n", i, trace_data[i].us,
+                   latency_input_name(button - 1), handling_ns[i]);
+        }
+    }
+    for (int i = 0; i < LATENCY_N_INPUTS; i++) {
+        const struct latency_handling *h = &inputs[i];
+
+        if (h->count > 0) {
+            printk("%-6s n=%u avg=%u ns max=%u ns\n", latency_input_name(i), h->count,
+                   (uint32_t)(h->total_ns / h->count), h->max_ns);
+        }
+    }
+
+#ifdef CONFIG_ARCH_POSIX
+    posix_exit(0);
+#endif
+}
+
+K_THREAD_DEFINE(replay_tid, REPLAY_STACK_SIZE, replay_thread, NULL, NULL, NULL,
+                REPLAY_PRIORITY, 0, REPLAY_START_MS);
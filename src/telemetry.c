@@ -0,0 +1,179 @@
+/** @file telemetry.c
+ * @brief Implementation of the sales and credit counters
+ *
+ * The counters are updated in O(1) by the
+ * state handlers and sent every
+ * CONFIG_APP_TELEMETRY_PERIOD_MS by the log thread as one
+ * fixed layout binary frame, so operators no
+ * longer have to parse the text log. The host
+ * side is tools/applog_decode.py.
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#include <zephyr.h>
+#include <device.h>
+#include <devicetree.h>
+#include <drivers/uart.h>
+#include <sys/byteorder.h>
+#include <sys/crc.h>
+#include <sys/printk.h>
+
+#include "applog.h"
+#include "telemetry.h"
+#include "uart_tx.h"
+
+static struct k_spinlock lock; /* A frame never mixes old and new counters */
+static struct telemetry_counters counters; /* Counters since boot */
+static uint32_t seq=0; /* Sequence number of the next frame */
+static uint32_t frames=0; /* Frames sent */
+static uint32_t bytes=0; /* Bytes of the frames sent */
+
+/**
+ * @brief telemetry_coin function count an inserted coin
+ *
+ * @param cents value of the coin
+ */
+
+void telemetry_coin(int cents){
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    switch (cents) {
+    case 10: counters.coins[0]++; break;
+    case 20: counters.coins[1]++; break;
+    case 50: counters.coins[2]++; break;
+    case 100: counters.coins[3]++; break;
+    }
+    k_spin_unlock(&lock, key);
+}
+
+/**
+ * @brief telemetry_vend function count a dispensed product
+ *
+ * @param sel_prod product, from 1 to CATALOG_SIZE
+ * @param price price charged in cents
+ */
+
+void telemetry_vend(int sel_prod, int price){
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    counters.vends[sel_prod - 1]++;
+    counters.revenue += price;
+    k_spin_unlock(&lock, key);
+}
+
+/**
+ * @brief telemetry_refused function count a refused selection
+ *
+ * @param sold_out true if the slot was empty, false if the credit was too low
+ */
+
+void telemetry_refused(bool sold_out){
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    if (sold_out) {
+        counters.sold_out++;
+    } else {
+        counters.no_credit++;
+    }
+    k_spin_unlock(&lock, key);
+}
+
+/**
+ * @brief telemetry_refund function count a payout
+ *
+ * @param cents amount paid back
+ */
+
+void telemetry_refund(int cents){
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    counters.refunds++;
+    counters.refunded += cents;
+    k_spin_unlock(&lock, key);
+}
+
+/**
+ * @brief telemetry_get function read the counters
+ *
+ * @param out where the counters are copied
+ */
+
+void telemetry_get(struct telemetry_counters *out){
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    *out = counters;
+    k_spin_unlock(&lock, key);
+}
+
+/**
+ * @brief telemetry_write function send a frame on the console UART
+ *
+ * With CONFIG_APP_UART_TX_ASYNC the frame goes
+ * to the output UART of uart_tx.c instead.
+ *
+ * Called by the log thread, the only writer
+ * of the console, so frames and text lines
+ * are never interleaved.
+ *
+ * @return number of bytes sent
+ */
+
+int telemetry_write(void){
+    static const struct device *uart __maybe_unused = DEVICE_DT_GET(DT_CHOSEN(zephyr_console));
+    struct telemetry_counters now;
+    const uint32_t *words = (const uint32_t *)&now;
+    uint8_t frame[TELEMETRY_FRAME_LEN];
+    size_t len = TELEMETRY_HEADER_LEN;
+
+    telemetry_get(&now);
+    frame[0] = TELEMETRY_SYNC;
+    frame[1] = TELEMETRY_VERSION;
+    frame[2] = TELEMETRY_PAYLOAD_LEN;
+    sys_put_le32(seq++, &frame[3]);
+    for (size_t i = 0; i < TELEMETRY_PAYLOAD_LEN / sizeof(uint32_t); i++) {
+        sys_put_le32(words[i], &frame[len]);
+        len += sizeof(uint32_t);
+    }
+    sys_put_le16(crc16_ccitt(0, &frame[1], len - 1), &frame[len]);
+    len += 2;
+
+#ifdef CONFIG_APP_UART_TX_ASYNC
+    uart_tx_write(frame, len);
+#else
+    for (size_t i = 0; i < len; i++) {
+        uart_poll_out(uart, frame[i]);
+    }
+#endif
+    frames++;
+    bytes += len;
+    return len;
+}
+
+/**
+ * @brief telemetry_report function print the counters and the output cost
+ *
+ * The text log bytes are those of the
+ * records printed since boot, to compare
+ * with the bytes of the frames.
+ *
+ */
+
+void telemetry_report(void){
+    struct telemetry_counters now;
+    struct applog_stats log;
+
+    telemetry_get(&now);
+    applog_stats_get(&log);
+    printk("Vends:");
+    for (int i = 0; i < CATALOG_SIZE; i++) {
+        printk(" %u", now.vends[i]);
+    }
+    printk(", revenue %u, coins %u/%u/%u/%u, refused %u+%u, refunds %u (%u)\n",
+           now.revenue, now.coins[0], now.coins[1], now.coins[2], now.coins[3],
+           now.no_credit, now.sold_out, now.refunds, now.refunded);
+    printk("Telemetry: %u frames, %u bytes; text log: %u records, %u bytes\n",
+           frames, bytes, log.records, log.bytes);
+}
@@ -0,0 +1,49 @@
+/** @file telemetry.h
+ * @brief Declarations of the sales and credit counters
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <zephyr.h>
+
+#include "catalog.h"
+#include "change.h"
+
+#define TELEMETRY_SYNC 0x5A /* First byte of a telemetry frame, APPLOG_SYNC is 0xA5 */
+#define TELEMETRY_VERSION 1 /* Bump when the frame layout changes */
+
+/* Counters since boot */
+struct telemetry_counters {
+    uint32_t vends[CATALOG_SIZE]; /* Products dispensed, product 1 first */
+    uint32_t revenue; /* Cents charged */
+    uint32_t coins[CHANGE_N_COINS]; /* Coins inserted, 10 cents first */
+    uint32_t no_credit; /* Selections refused for missing credit */
+    uint32_t sold_out; /* Selections refused for an empty slot */
+    uint32_t refunds; /* Payouts of credit or change */
+    uint32_t refunded; /* Cents paid back */
+};
+
+/*
+ * Frame, little endian: TELEMETRY_SYNC, TELEMETRY_VERSION,
+ * length of the payload (u8), sequence number (u32), the
+ * counters in the order of struct telemetry_counters (u32 each),
+ * CRC-16/CCITT of everything from the version on (u16)
+ */
+#define TELEMETRY_HEADER_LEN 7
+#define TELEMETRY_PAYLOAD_LEN sizeof(struct telemetry_counters)
+#define TELEMETRY_FRAME_LEN (TELEMETRY_HEADER_LEN + TELEMETRY_PAYLOAD_LEN + 2)
+
+void telemetry_coin(int cents);
+void telemetry_vend(int sel_prod, int price);
+void telemetry_refused(bool sold_out);
+void telemetry_refund(int cents);
+void telemetry_get(struct telemetry_counters *out);
+int telemetry_write(void);
+void telemetry_report(void);
+
+#endif /* TELEMETRY_H */
@@ -0,0 +1,84 @@
+/** @file threads.c
+ * @brief Implementation of the thread statistics
+ *
+ * For every thread, main, idle and the work
+ * queues included, prints the stack size, the
+ * most ever used (high-water mark, from the
+ * 0xAA fill of CONFIG_INIT_STACKS) and the
+ * share of CPU time since boot. The interrupt
+ * stack is measured the same way. Stack sizes
+ * can then be cut to the measured use plus a
+ * margin.
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#include <zephyr.h>
+#include <sys/printk.h>
+
+#include "threads.h"
+
+#define THREADS_STACK_FILL 0xAA /* Value written by CONFIG_INIT_STACKS */
+
+K_KERNEL_STACK_ARRAY_EXTERN(z_interrupt_stacks, CONFIG_MP_NUM_CPUS, CONFIG_ISR_STACK_SIZE);
+
+static uint64_t total_cycles; /* CPU time of all threads, for the percentages */
+
+/**
+ * @brief thread_line function print the statistics of a thread
+ *
+ * @param thread thread to print
+ * @param user_data not used
+ */
+
+static void thread_line(const struct k_thread *thread, void *user_data){
+    struct k_thread *t = (struct k_thread *)thread;
+    k_thread_runtime_stats_t rt;
+    size_t size = t->stack_info.size;
+    size_t unused = 0;
+    const char *name = k_thread_name_get(t);
+
+    k_thread_stack_space_get(t, &unused);
+    k_thread_runtime_stats_get(t, &rt);
+    printk("%-16s %5u %5u %3u%% %3u.%u%%\n", name != NULL ? name : "?",
+           (uint32_t)size, (uint32_t)(size - unused), (uint32_t)((size - unused) * 100 / size),
+           (uint32_t)(rt.execution_cycles * 100 / total_cycles),
+           (uint32_t)(rt.execution_cycles * 1000 / total_cycles % 10));
+}
+
+/**
+ * @brief isr_stack_used function measure the interrupt stack
+ *
+ * @return bytes of the interrupt stack ever used
+ */
+
+static size_t isr_stack_used(void){
+    const uint8_t *buf = (const uint8_t *)Z_KERNEL_STACK_BUFFER(z_interrupt_stacks[0]);
+    size_t unused = 0;
+
+    /* The stack grows down, the untouched fill is at the bottom */
+    while (unused < CONFIG_ISR_STACK_SIZE && buf[unused] == THREADS_STACK_FILL) {
+        unused++;
+    }
+    return CONFIG_ISR_STACK_SIZE - unused;
+}
+
+/**
+ * @brief threads_report function print the statistics of all threads
+ *
+ */
+
+void threads_report(void){
+    k_thread_runtime_stats_t all;
+    size_t isr_used = isr_stack_used();
+
+    k_thread_runtime_stats_all_get(&all);
+    total_cycles = MAX(all.execution_cycles, 1);
+
+    printk("%-16s %5s %5s %4s %6s\n", "thread", "stack", "used", "", "cpu");
+    k_thread_foreach(thread_line, NULL);
+    printk("%-16s %5u %5u %3u%%\n", "ISR", CONFIG_ISR_STACK_SIZE, (uint32_t)isr_used,
+           (uint32_t)(isr_used * 100 / CONFIG_ISR_STACK_SIZE));
+}
@@ -0,0 +1,16 @@
+/** @file threads.h
+ * @brief Declarations of the thread statistics
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#ifndef THREADS_H
+#define THREADS_H
+
+#include <zephyr.h>
+
+void threads_report(void);
+
+#endif /* THREADS_H */
@@ -0,0 +1,109 @@
+/** @file trace.c
+ * @brief Implementation of the input trace recorder
+ *
+ * Every button edge and every press reaching
+ * the state machine is stored with its time in
+ * a RAM ring of TRACE_SIZE entries; recording
+ * costs a few stores in the ISR. trace_dump()
+ * prints the ring on the console, from which
+ * tools/trace2c.py builds a trace that
+ * replay.c feeds back to the state machine on
+ * the board or on native_posix.
+ *
+ * Dump format, one line per entry, times in us
+ * from the first entry:
+ *
+ *   TRACE BEGIN <entries>
+ *   <us> <pin> <E|P|C>
+ *   TRACE END
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#include <zephyr.h>
+#include <sys/printk.h>
+
+#include "trace.h"
+
+static struct k_spinlock lock; /* Edges and presses come from different ISRs */
+static struct trace_entry ring[TRACE_SIZE]; /* Recorded inputs */
+static uint32_t head=0; /* Entries ever recorded, the next goes to head % TRACE_SIZE */
+static bool paused=false; /* Set while the ring is printed */
+
+/**
+ * @brief trace_put function store an entry
+ *
+ * @param pin pin of the button
+ * @param kind TRACE_EDGE, TRACE_PRESS or TRACE_CMD
+ */
+
+static void trace_put(uint8_t pin, uint8_t kind){
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    if (!paused) {
+        struct trace_entry *e = &ring[head % TRACE_SIZE];
+
+        e->cycles = k_cycle_get_32();
+        e->pin = pin;
+        e->kind = kind;
+        head++;
+    }
+    k_spin_unlock(&lock, key);
+}
+
+/**
+ * @brief trace_edges function record the edges of a GPIO interrupt
+ *
+ * @param pins mask of the pins that triggered
+ */
+
+void trace_edges(uint32_t pins){
+    while (pins != 0) {
+        uint8_t pin = find_lsb_set(pins) - 1;
+
+        trace_put(pin, TRACE_EDGE);
+        pins &= ~BIT(pin);
+    }
+}
+
+/**
+ * @brief trace_input function record a press given to the state machine
+ *
+ * @param pin pin of the button
+ * @param kind TRACE_PRESS or TRACE_CMD
+ */
+
+void trace_input(uint8_t pin, uint8_t kind){
+    trace_put(pin, kind);
+}
+
+/**
+ * @brief trace_dump function print the recorded inputs, oldest first
+ *
+ * Recording is paused while printing.
+ *
+ */
+
+void trace_dump(void){
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    uint32_t n = MIN(head, (uint32_t)TRACE_SIZE);
+    uint32_t first = head - n;
+
+    paused = true;
+    k_spin_unlock(&lock, key);
+
+    printk("TRACE BEGIN %u\n", n);
+    for (uint32_t i = first; i < head; i++) {
+        const struct trace_entry *e = &ring[i % TRACE_SIZE];
+        uint32_t cycles = e->cycles - ring[first % TRACE_SIZE].cycles;
+
+        printk("%u %u %c\n", (uint32_t)k_cyc_to_us_floor64(cycles), e->pin, e->kind);
+    }
+    printk("TRACE END\n");
+
+    key = k_spin_lock(&lock);
+    paused = false;
+    k_spin_unlock(&lock, key);
+}
@@ -0,0 +1,38 @@
+/** @file trace.h
+ * @brief Declarations of the input trace recorder
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <zephyr.h>
+
+#define TRACE_SIZE 512 /* Entries kept, the oldest are overwritten */
+
+/* Kinds of entry */
+#define TRACE_EDGE 'E' /* Edge seen by the GPIO ISR, before the debounce */
+#define TRACE_PRESS 'P' /* Stable press delivered by the debounce */
+#define TRACE_CMD 'C' /* Press injected by the command channel */
+
+/* One recorded input */
+struct trace_entry {
+    uint32_t cycles; /* k_cycle_get_32() when it happened */
+    uint8_t pin; /* Pin of the button */
+    uint8_t kind; /* TRACE_EDGE, TRACE_PRESS or TRACE_CMD */
+};
+
+/* One press of a trace to replay, see tools/trace2c.py */
+struct trace_step {
+    uint32_t us; /* Time from the first press of the trace */
+    uint8_t pin; /* Pin of the button */
+};
+
+void trace_edges(uint32_t pins);
+void trace_input(uint8_t pin, uint8_t kind);
+void trace_dump(void);
+
+#endif /* TRACE_H */
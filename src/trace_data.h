@@ -0,0 +1,12 @@
+/* Generated by tools/trace2c.py, 8 presses */
+
+static const struct trace_step trace_data[] = {
+    { 0, 29 },
+    { 700000, 28 },
+    { 1500000, 11 },
+    { 2300000, 24 },
+    { 3100000, 3 },
+    { 3400000, 12 },
+    { 4000000, 24 },
+    { 5000000, 25 },
+};
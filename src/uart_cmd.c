@@ -0,0 +1,261 @@
+/** @file uart_cmd.c
+ * @brief Command channel on the console UART
+ *
+ * Lets a host script drive the machine without
+ * the buttons. Every command is one character,
+ * so many of them can be sent in one batch;
+ * blanks, ';' and line ends are ignored.
+ *
+ *   c<cents>  insert a coin of 10, 20, 50 or 100,
+ *             must be followed by a non-digit byte
+ *   u d       browse up, down
+ *   s         select the product
+ *   r         return the credit
+ *   q         print state, product and credit
+ *
+ * Upper case letters print the diagnostics: L the
+ * latency histograms (and, with
+ * CONFIG_APP_DISPATCH_STATS, the cost of the
+ * input path), Z resets them, P the power
+ * figures, S the storage, J the journal, T the
+ * telemetry counters, H the threads, D the
+ * input trace (see trace.c), V the dispenser,
+ * O the display output, W the cost of the output
+ * path, A the coin acceptor, C the counters of
+ * this channel.
+ *
+ * The digits of a coin may come in two reads of
+ * the UART ("c10", then "0"), so the coin is
+ * only inserted when the byte after its value
+ * arrives: the next command, a blank, ';' or a
+ * line end. A batch that ends with a coin must
+ * end with one of them, or the coin waits for
+ * the next byte.
+ *
+ * The RX interrupt reads the UART FIFO straight
+ * into the free space of a ring buffer, and the
+ * parser thread reads the commands in place from
+ * it, so no byte is copied. When the ring is
+ * full the RX interrupt is masked until the
+ * parser frees some space.
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#include <zephyr.h>
+#include <device.h>
+#include <devicetree.h>
+#include <drivers/uart.h>
+#include <sys/printk.h>
+#include <sys/ring_buffer.h>
+
+#include "applog.h"
+#include "coin_pulse.h"
+#include "dispenser.h"
+#include "display.h"
+#include "journal.h"
+#include "latency.h"
+#include "persist.h"
+#include "power.h"
+#include "telemetry.h"
+#include "threads.h"
+#include "trace.h"
+#include "vending.h"
+
+#define UART_CMD_RING_SIZE 256 /* Bytes received and not yet parsed */
+#define UART_CMD_STACK_SIZE 1024 /* Stack of the parser, the reports use printk */
+#define UART_CMD_PRIORITY 5 /* Below the transaction thread, above the log thread */
+
+/* Counters of the command channel */
+struct uart_cmd_stats {
+    uint32_t bytes; /* Bytes received */
+    uint32_t commands; /* Commands executed */
+    uint32_t errors; /* Unknown commands and coins */
+    uint32_t full; /* Times the ring filled up */
+};
+
+RING_BUF_DECLARE(rx_ring, UART_CMD_RING_SIZE);
+K_SEM_DEFINE(rx_sem, 0, 1);
+
+static const struct device *uart = DEVICE_DT_GET(DT_CHOSEN(zephyr_console));
+static struct uart_cmd_stats stats; /* Counters */
+static bool coin_pending=false; /* 'c' received, reading the value */
+static int coin_cents; /* Value of the coin read so far */
+
+/**
+ * @brief uart_cmd_isr function move the received bytes to the ring
+ *
+ * @param dev console UART
+ * @param user_data not used
+ */
+
+static void uart_cmd_isr(const struct device *dev, void *user_data){
+    while (uart_irq_update(dev) && uart_irq_rx_ready(dev)) {
+        uint8_t *dst;
+        uint32_t room = ring_buf_put_claim(&rx_ring, &dst, UART_CMD_RING_SIZE);
+        int n;
+
+        if (room == 0) {
+            /* The parser enables RX again once it has read the ring */
+            uart_irq_rx_disable(dev);
+            stats.full++;
+            break;
+        }
+        n = uart_fifo_read(dev, dst, room);
+        ring_buf_put_finish(&rx_ring, MAX(n, 0));
+        if (n > 0) {
+            stats.bytes += n;
+            k_sem_give(&rx_sem);
+        }
+    }
+}
+
+/**
+ * @brief coin_button function return the button of a coin
+ *
+ * @param cents value of the coin
+ * @return button, 0 if there is no such coin
+ */
+
+static uint8_t coin_button(int cents){
+    switch (cents) {
+    case 10: return 5;
+    case 20: return 6;
+    case 50: return 7;
+    case 100: return 8;
+    default: return 0;
+    }
+}
+
+/**
+ * @brief uart_cmd_byte function handle one received byte
+ *
+ * @param c byte
+ */
+
+static void uart_cmd_byte(uint8_t c){
+    uint8_t button = 0;
+
+    if (coin_pending) {
+        if (c >= '0' && c <= '9' && coin_cents < 1000) {
+            coin_cents = coin_cents * 10 + (c - '0');
+            return;
+        }
+        coin_pending = false;
+        button = coin_button(coin_cents);
+        if (button == 0) {
+            stats.errors++;
+        } else {
+            vending_inject(button);
+            stats.commands++;
+        }
+    }
+
+    switch (c) {
+    case 'c':
+        coin_pending = true;
+        coin_cents = 0;
+        return;
+    case 'u': button = 1; break;
+    case 'd': button = 2; break;
+    case 's': button = 3; break;
+    case 'r': button = 4; break;
+    case 'q':
+        vending_inject(VENDING_QUERY);
+        stats.commands++;
+        return;
+    case 'L':
+        latency_dump();
+#ifdef CONFIG_APP_DISPATCH_STATS
+        vending_dispatch_report();
+#endif
+        return;
+    case 'Z':
+        vending_inject(VENDING_RESET);
+        printk("Latency histograms reset\n");
+        return;
+    case 'P':
+        power_report();
+        return;
+    case 'S':
+        persist_report();
+        return;
+    case 'J':
+        journal_report();
+        return;
+    case 'T':
+        telemetry_report();
+        return;
+    case 'H':
+#ifdef CONFIG_APP_THREAD_STATS
+        threads_report();
+#endif
+        return;
+    case 'D':
+        trace_dump();
+        return;
+    case 'V':
+        dispenser_report();
+        return;
+    case 'O':
+#ifdef CONFIG_APP_DISPLAY
+        display_report();
+#endif
+        return;
+    case 'W':
+        applog_report();
+        return;
+    case 'A':
+#ifdef CONFIG_APP_COIN_PULSE
+        coin_pulse_report();
+#endif
+        return;
+    case 'C':
+        printk("Commands: %u bytes, %u commands, %u errors, ring full %u times\n",
+               stats.bytes, stats.commands, stats.errors, stats.full);
+        return;
+    case ' ':
+    case ';':
+    case '\r':
+    case '\n':
+        return;
+    default:
+        stats.errors++;
+        return;
+    }
+    vending_inject(button);
+    stats.commands++;
+}
+
+/**
+ * @brief uart_cmd_thread function parse the commands in the ring
+ *
+ */
+
+static void uart_cmd_thread(void){
+    if (!device_is_ready(uart)) {
+        printk("Error: console UART not ready, no command channel\n");
+        return;
+    }
+    uart_irq_callback_user_data_set(uart, uart_cmd_isr, NULL);
+    uart_irq_rx_enable(uart);
+
+    while (1) {
+        uint8_t *data;
+        uint32_t n;
+
+        k_sem_take(&rx_sem, K_FOREVER);
+        while ((n = ring_buf_get_claim(&rx_ring, &data, UART_CMD_RING_SIZE)) > 0) {
+            for (uint32_t i = 0; i < n; i++) {
+                uart_cmd_byte(data[i]);
+            }
+            ring_buf_get_finish(&rx_ring, n);
+            uart_irq_rx_enable(uart);
+        }
+    }
+}
+
+K_THREAD_DEFINE(uart_cmd_tid, UART_CMD_STACK_SIZE, uart_cmd_thread,
+                NULL, NULL, NULL, UART_CMD_PRIORITY, 0, 0);
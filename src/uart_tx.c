@@ -0,0 +1,269 @@
+/** @file uart_tx.c
+ * @brief Implementation of the asynchronous output UART
+ *
+ * Two buffers: the log thread fills one while
+ * the other is being sent. A write copies what
+ * fits into the fill buffer and, if no transfer
+ * is in flight, hands the buffer to uart_tx()
+ * and swaps. The UART_TX_DONE callback starts
+ * the buffer filled meanwhile, if any, so the
+ * line is kept busy without the CPU feeding
+ * characters. Only when both buffers are taken
+ * the writer waits, and it is the lowest
+ * priority thread.
+ *
+ * The UART is the chosen app,output-uart of the
+ * devicetree (uart1 on the nRF52840 DK, see
+ * boards/nrf52840dk_nrf52840.overlay): the nRF
+ * UARTE driver cannot run the async API and the
+ * interrupt driven API of the command channel on
+ * the same instance.
+ *
+ * Without CONFIG_UART_ASYNC_API a delayed work
+ * item plays the DMA: it waits for the time the
+ * bytes take at UART_TX_EMUL_BAUD, writes them to
+ * the console and completes the transfer.
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#include <zephyr.h>
+#include <device.h>
+#include <devicetree.h>
+#include <drivers/uart.h>
+#include <sys/printk.h>
+#include <string.h>
+#include <timing/timing.h>
+
+#include "uart_tx.h"
+
+#ifdef CONFIG_UART_ASYNC_API
+BUILD_ASSERT(DT_HAS_CHOSEN(app_output_uart), "No app,output-uart chosen in the devicetree");
+#define UART_TX_NODE DT_CHOSEN(app_output_uart)
+#else
+#define UART_TX_NODE DT_CHOSEN(zephyr_console)
+#endif
+
+static const struct device *uart = DEVICE_DT_GET(UART_TX_NODE);
+static uint8_t bufs[2][UART_TX_BUF_SIZE]; /* In RAM, EasyDMA cannot read flash */
+static uint8_t fill; /* Buffer being filled */
+static size_t fill_len; /* Bytes in the fill buffer */
+static bool sending; /* The other buffer is in flight */
+static struct k_spinlock lock; /* Shared with the completion callback */
+K_SEM_DEFINE(tx_free_sem, 0, 1); /* Given at the end of every transfer */
+static struct uart_tx_stats stats; /* Counters, see uart_tx_stats_get() */
+
+static void uart_tx_done(bool ok);
+
+#ifdef CONFIG_UART_ASYNC_API
+
+/**
+ * @brief uart_tx_callback function end of a DMA transfer
+ *
+ * @param dev output UART
+ * @param evt event of the async API
+ * @param user_data not used
+ */
+
+static void uart_tx_callback(const struct device *dev, struct uart_event *evt, void *user_data){
+    switch (evt->type) {
+    case UART_TX_DONE:
+        uart_tx_done(true);
+        break;
+    case UART_TX_ABORTED:
+        uart_tx_done(false);
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief uart_tx_send function start a DMA transfer
+ *
+ * @param buf buffer to send, must stay untouched until the end
+ * @param len number of bytes
+ * @return 0 on success, a negative errno otherwise
+ */
+
+static int uart_tx_send(const uint8_t *buf, size_t len){
+    return uart_tx(uart, buf, len, SYS_FOREVER_MS);
+}
+
+#else /* !CONFIG_UART_ASYNC_API */
+
+static const uint8_t *emul_buf; /* Buffer of the emulated transfer */
+static size_t emul_len; /* Its length */
+
+/**
+ * @brief uart_tx_emul_handler function end of an emulated transfer
+ *
+ * @param work tx_emul_work
+ */
+
+static void uart_tx_emul_handler(struct k_work *work){
+    for (size_t i = 0; i < emul_len; i++) {
+        uart_poll_out(uart, emul_buf[i]);
+    }
+    uart_tx_done(true);
+}
+
+K_WORK_DELAYABLE_DEFINE(tx_emul_work, uart_tx_emul_handler);
+
+/**
+ * @brief uart_tx_send function start an emulated transfer
+ *
+ * @param buf buffer to send, must stay untouched until the end
+ * @param len number of bytes
+ * @return 0
+ */
+
+static int uart_tx_send(const uint8_t *buf, size_t len){
+    emul_buf = buf;
+    emul_len = len;
+    /* 10 bits per byte: start, 8 data, stop */
+    k_work_schedule(&tx_emul_work, K_USEC((uint64_t)len * 10 * USEC_PER_SEC / UART_TX_EMUL_BAUD));
+    return 0;
+}
+
+#endif /* CONFIG_UART_ASYNC_API */
+
+/**
+ * @brief uart_tx_start function send the fill buffer and swap
+ *
+ * Called with the lock held and no transfer in
+ * flight. A refused transfer loses its bytes,
+ * the log must not wait for a broken line.
+ *
+ */
+
+static void uart_tx_start(void){
+    if (uart_tx_send(bufs[fill], fill_len) == 0) {
+        sending = true;
+        stats.transfers++;
+        stats.max_transfer = MAX(stats.max_transfer, fill_len);
+        fill ^= 1;
+    } else {
+        stats.errors++;
+    }
+    fill_len = 0;
+}
+
+/**
+ * @brief uart_tx_done function recycle the buffer just sent
+ *
+ * @param ok false if the transfer was aborted
+ */
+
+static void uart_tx_done(bool ok){
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    sending = false;
+    if (!ok) {
+        stats.errors++;
+    }
+    if (fill_len > 0) {
+        uart_tx_start();
+    }
+    k_spin_unlock(&lock, key);
+    k_sem_give(&tx_free_sem);
+}
+
+/**
+ * @brief uart_tx_init function register the completion callback
+ *
+ * @return 0 on success, a negative errno otherwise
+ */
+
+int uart_tx_init(void){
+    if (!device_is_ready(uart)) {
+        printk("Error: output UART %s not ready\n", uart->name);
+        return -ENODEV;
+    }
+#ifdef CONFIG_UART_ASYNC_API
+    return uart_callback_set(uart, uart_tx_callback, NULL);
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief uart_tx_write function queue bytes on the output UART
+ *
+ * uart_tx_write copies the bytes and returns
+ * without waiting for the line, unless both
+ * buffers are taken. Only the log thread calls
+ * it.
+ *
+ * @param data bytes to send
+ * @param len number of bytes
+ */
+
+void uart_tx_write(const void *data, size_t len){
+    const uint8_t *src = data;
+    bool stalled = false;
+    timing_t start = 0;
+
+    while (len > 0) {
+        k_spinlock_key_t key = k_spin_lock(&lock);
+        size_t n = MIN(len, UART_TX_BUF_SIZE - fill_len);
+
+        memcpy(&bufs[fill][fill_len], src, n);
+        fill_len += n;
+        src += n;
+        len -= n;
+        stats.bytes += n;
+        if (!sending) {
+            uart_tx_start();
+        }
+        k_spin_unlock(&lock, key);
+
+        if (len > 0) {
+            /* Fill buffer full and the other one in flight */
+            if (!stalled) {
+                stalled = true;
+                stats.stalls++;
+                start = timing_counter_get();
+            }
+            k_sem_take(&tx_free_sem, K_FOREVER);
+        }
+    }
+
+    if (stalled) {
+        timing_t end = timing_counter_get();
+        uint32_t us = (uint32_t)(timing_cycles_to_ns(timing_cycles_get(&start, &end)) / 1000);
+
+        stats.max_stall_us = MAX(stats.max_stall_us, us);
+    }
+}
+
+/**
+ * @brief uart_tx_stats_get function read the output UART counters
+ *
+ * @param out where the counters are copied
+ */
+
+void uart_tx_stats_get(struct uart_tx_stats *out){
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    *out = stats;
+    k_spin_unlock(&lock, key);
+}
+
+/**
+ * @brief uart_tx_report function print the output UART counters
+ *
+ */
+
+void uart_tx_report(void){
+    struct uart_tx_stats now;
+
+    uart_tx_stats_get(&now);
+    printk("Output UART %s%s: %u bytes in %u transfers (%u per transfer, longest %u)\n",
+           uart->name, IS_ENABLED(CONFIG_UART_ASYNC_API) ? "" : " (emulated)", now.bytes,
+           now.transfers, now.bytes / MAX(now.transfers, 1), now.max_transfer);
+    printk("Buffers full %u times, worst wait %u us, %u errors\n", now.stalls,
+           now.max_stall_us, now.errors);
+}
@@ -0,0 +1,41 @@
+/** @file uart_tx.h
+ * @brief Declarations of the asynchronous output UART
+ *
+ * Double buffered transmit path for the output of
+ * the log thread (text lines, display frames,
+ * binary and telemetry frames). uart_tx_write()
+ * copies the bytes into the buffer being filled
+ * and returns; the other buffer is sent by the
+ * UARTE EasyDMA and the end of its transfer
+ * starts the next one. Without the async UART API
+ * (native_posix) the transfers are emulated.
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#ifndef UART_TX_H
+#define UART_TX_H
+
+#include <zephyr.h>
+
+#define UART_TX_BUF_SIZE 256 /* Size of each of the two buffers */
+#define UART_TX_EMUL_BAUD 115200 /* Line rate of the emulated transfers */
+
+/* Counters of the output UART */
+struct uart_tx_stats {
+    uint32_t bytes; /* Bytes written */
+    uint32_t transfers; /* DMA transfers started */
+    uint32_t max_transfer; /* Longest transfer in bytes */
+    uint32_t stalls; /* Writes that waited for a free buffer */
+    uint32_t max_stall_us; /* Worst wait for a free buffer */
+    uint32_t errors; /* Transfers refused or aborted, their bytes are lost */
+};
+
+int uart_tx_init(void);
+void uart_tx_write(const void *data, size_t len);
+void uart_tx_stats_get(struct uart_tx_stats *out);
+void uart_tx_report(void);
+
+#endif /* UART_TX_H */
@@ -0,0 +1,54 @@
+/** @file vending.h
+ * @brief Declarations shared with the vending machine in main.c
+ *
+ * Board wiring of the buttons and the totals
+ * of the machine, used by the code that drives
+ * or checks the machine from outside main.c.
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#ifndef VENDING_H
+#define VENDING_H
+
+#include <zephyr.h>
+#include <devicetree.h>
+
+/* Refer to dts file */
+#define GPIO0_NID DT_NODELABEL(gpio0) 
+#define BOARDBUT1 0xb /* Pin at which BUT1 is connected. Addressing is direct (i.e., pin number) */
+#define BOARDBUT2 0xc /* Pin at which BUT2 is connected. Addressing is direct (i.e., pin number) */
+#define BOARDBUT3 0x18 /* Pin at which BUT3 is connected. Addressing is direct (i.e., pin number) */
+#define BOARDBUT4 0x19 /* Pin at which BUT4 is connected. Addressing is direct (i.e., pin number) */
+
+#define BOARDBUT5 0x3 /* Pin at which BUT5 is connected. Addressing is direct (i.e., pin number) */
+#define BOARDBUT6 0x4 /* Pin at which BUT6 is connected. Addressing is direct (i.e., pin number) */
+#define BOARDBUT7 0x1C /* Pin at which BUT7 is connected. Addressing is direct (i.e., pin number) */
+#define BOARDBUT8 0x1D /* Pin at which BUT8 is connected. Addressing is direct (i.e., pin number) */
+#define BOARDCOIN 0x1F /* Pulse line of the coin acceptor (CONFIG_APP_COIN_PULSE), P0.31 */
+
+/* Money and products handled since boot */
+struct vending_totals {
+    uint32_t inserted; /* Cents inserted as coins */
+    uint32_t spent; /* Cents charged for dispensed products */
+    uint32_t returned; /* Cents given back to the customers */
+    uint32_t vends; /* Products dispensed */
+    uint32_t failed; /* Selections refused (ERROR state) */
+    int32_t credit; /* Current credit */
+};
+
+#define VENDING_BUTTONS 8 /* BUT1 ... BUT8 */
+#define VENDING_QUERY 0 /* Not a button: vending_inject() reports the state */
+#define VENDING_RESET 0xFF /* Not a button: vending_inject() clears the latency statistics */
+
+extern const uint8_t vending_button_pins[VENDING_BUTTONS];
+
+void vending_totals_get(struct vending_totals *totals);
+uint32_t vending_pending(void);
+int vending_inject(uint8_t button);
+bool vending_press(uint8_t pin);
+void vending_dispatch_report(void);
+
+#endif /* VENDING_H */
@@ -0,0 +1,200 @@
+/** @file bench.c
+ * @brief Cycle counted benchmarks of the state machine
+ *
+ * Runs every input of the vending machine on a
+ * machine of its own, built from machine.c,
+ * fsm.c, catalog.c, change.c and applog_format.c
+ * only, and measures it in timing API cycles
+ * with interrupts locked. Each benchmark is run
+ * CONFIG_BENCH_RUNS times from the same
+ * starting state; the minimum, median and maximum
+ * are printed as one line per benchmark:
+ *
+ *   BENCH_BEGIN board=<board> freq=<Hz> runs=<n>
+ *   BENCH <name> min=<cycles> med=<cycles> max=<cycles>
+ *   BENCH_END
+ *
+ * tools/bench_check.py compares the medians with
+ * the baselines of tools/bench_baseline.json.
+ * The credit left by every run is checked too,
+ * so a benchmark that stops taking its path
+ * fails instead of getting faster.
+ *
+ * The machine has no hooks and its fsm does not
+ * time itself, so the time is the state machine
+ * alone; the empty benchmark is the cost of the
+ * measurement itself.
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#include <zephyr.h>
+#include <sys/printk.h>
+#include <timing/timing.h>
+
+#include "applog.h"
+#include "bench.h"
+#include "change.h"
+#include "machine.h"
+
+/* A benchmark: the starting state, then one event or one call */
+struct bench {
+    const char *name; /* Name in the report and in the baselines */
+    void (*setup)(struct machine *m); /* Prepare the machine, not measured */
+    uint8_t event; /* Event stepped, FSM_NO_EVENT to call run instead */
+    void (*run)(struct machine *m); /* Code measured when event is FSM_NO_EVENT */
+    int32_t credit; /* Credit the run must leave */
+};
+
+static const struct machine_ops bench_ops; /* No hooks */
+static struct machine bm; /* Machine under test */
+static uint32_t samples[CONFIG_BENCH_RUNS]; /* Cycles of each run */
+static char line[96]; /* Output of the formatting benchmarks */
+
+/* Starting states, every one from idle whatever the previous benchmark left */
+
+static void setup_idle(struct machine *m){
+    m->sel_prod = 1;
+    machine_set_credit(m, 0);
+}
+
+static void setup_first(struct machine *m){
+    setup_idle(m);
+}
+
+static void setup_last(struct machine *m){
+    setup_idle(m);
+    m->sel_prod = CATALOG_SIZE;
+}
+
+/* Enough credit for the most expensive product, full slot and tubes */
+static void setup_paid(struct machine *m){
+    uint16_t full[CATALOG_SIZE];
+
+    for (int i = 0; i < CATALOG_SIZE; i++) {
+        full[i] = catalog_get(i + 1)->stock;
+    }
+    catalog_restore(&m->catalog, full);
+    change_fill(&m->tubes);
+    m->sel_prod = 1;
+    machine_set_credit(m, 180);
+}
+
+static void setup_sold_out(struct machine *m){
+    setup_paid(m);
+    while (catalog_take(&m->catalog, 1)) {
+    }
+}
+
+/* Code measured by the benchmarks that are not an input event */
+
+static void run_empty(struct machine *m){
+}
+
+static void run_vend_done(struct machine *m){
+    machine_vend_done(m, 1);
+}
+
+static void run_format_credit(struct machine *m){
+    struct applog_record rec = { .id = APPLOG_CREDIT, .product = 1, .credit = 170 };
+
+    applog_format(&rec, line, sizeof(line));
+}
+
+static void run_format_product(struct machine *m){
+    struct applog_record rec = { .id = APPLOG_PRODUCT, .product = 1, .credit = 170 };
+
+    applog_format(&rec, line, sizeof(line));
+}
+
+/* The benchmarks, in report order, with the credit they leave */
+static const struct bench benches[] = {
+    { "empty", setup_idle, FSM_NO_EVENT, run_empty, 0 },
+    { "coin_c10", setup_idle, EV_C10, NULL, 10 },
+    { "coin_c20", setup_idle, EV_C20, NULL, 20 },
+    { "coin_c50", setup_idle, EV_C50, NULL, 50 },
+    { "coin_c100", setup_idle, EV_C100, NULL, 100 },
+    { "browse_up", setup_first, EV_UP, NULL, 0 },
+    { "browse_down", setup_last, EV_DOWN, NULL, 0 },
+    /* DISPENSING superstate: COMPARISON, OK, PAYOUT, DISPENSE */
+    { "select_ok", setup_paid, EV_SELECT, NULL, 0 },
+    /* DISPENSING superstate: COMPARISON, ERROR, DISPENSE */
+    { "select_no_credit", setup_idle, EV_SELECT, NULL, 0 },
+    { "select_sold_out", setup_sold_out, EV_SELECT, NULL, 180 },
+    { "return", setup_paid, EV_RETURN, NULL, 0 },
+    { "vend_done", setup_idle, FSM_NO_EVENT, run_vend_done, 0 },
+    { "format_credit", setup_idle, FSM_NO_EVENT, run_format_credit, 0 },
+    { "format_product", setup_idle, FSM_NO_EVENT, run_format_product, 0 },
+};
+
+/**
+ * @brief bench_one function run a benchmark and print its line
+ *
+ * @param b benchmark
+ * @return true if every run left the expected credit
+ */
+
+static bool bench_one(const struct bench *b){
+    bool ok = true;
+
+    for (int i = 0; i < CONFIG_BENCH_RUNS; i++) {
+        timing_t start, end;
+        unsigned int key;
+        uint32_t cycles;
+        int j = i;
+
+        b->setup(&bm);
+        key = irq_lock();
+        start = timing_counter_get();
+        if (b->event != FSM_NO_EVENT) {
+            machine_step(&bm, b->event);
+        } else {
+            b->run(&bm);
+        }
+        end = timing_counter_get();
+        irq_unlock(key);
+        ok = ok && bm.credit == b->credit;
+
+        /* Insertion sort, the median is in the middle */
+        cycles = (uint32_t)timing_cycles_get(&start, &end);
+        while (j > 0 && samples[j - 1] > cycles) {
+            samples[j] = samples[j - 1];
+            j--;
+        }
+        samples[j] = cycles;
+    }
+    printk("BENCH %s min=%u med=%u max=%u\n", b->name, samples[0],
+           samples[CONFIG_BENCH_RUNS / 2], samples[CONFIG_BENCH_RUNS - 1]);
+    if (!ok) {
+        printk("BENCH_FAIL %s: credit %d, expected %d\n", b->name, bm.credit, b->credit);
+    }
+    return ok;
+}
+
+/**
+ * @brief bench_run function run all the benchmarks once
+ *
+ * @return number of benchmarks that left a wrong credit
+ */
+
+int bench_run(void){
+    int failed = 0;
+
+    catalog_init();
+    change_init();
+    timing_init();
+    timing_start();
+    machine_init(&bm, &bench_ops, NULL);
+    bm.fsm.timed = false;
+
+    printk("BENCH_BEGIN board=%s freq=%u runs=%u\n", CONFIG_BOARD,
+           (uint32_t)timing_freq_get(), CONFIG_BENCH_RUNS);
+    for (int i = 0; i < ARRAY_SIZE(benches); i++) {
+        failed += !bench_one(&benches[i]);
+    }
+    printk("BENCH_END\n");
+    timing_stop();
+    return failed;
+}
@@ -0,0 +1,14 @@
+/** @file bench.h
+ * @brief Declarations of the state machine benchmarks
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+int bench_run(void);
+
+#endif /* BENCH_H */
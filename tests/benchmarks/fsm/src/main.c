@@ -0,0 +1,32 @@
+/** @file main.c
+ * @brief ztest suite of the state machine benchmarks
+ *
+ * One test runs every benchmark of bench.c and
+ * fails if one of them left the machine with the
+ * wrong credit. The BENCH lines it prints are
+ * checked against the baselines by
+ * tools/bench_check.py.
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#include <ztest.h>
+
+#include "bench.h"
+
+/**
+ * @brief test_fsm_bench function run the benchmarks
+ *
+ */
+
+static void test_fsm_bench(void){
+    zassert_equal(bench_run(), 0, "A benchmark did not take its path");
+}
+
+void test_main(void){
+    ztest_test_suite(fsm_bench,
+                     ztest_unit_test(test_fsm_bench));
+    ztest_run_test_suite(fsm_bench);
+}
@@ -0,0 +1,141 @@
+#!/usr/bin/env python3
+"""Decode the binary application log (CONFIG_APP_LOG_BINARY=y).
+
+Reads the console byte stream from a file or stdin and prints the same
+lines the firmware prints in text mode. Bytes outside a frame (boot
+messages printed with printk) are passed through unchanged.
+
+Telemetry frames (src/telemetry.h) are printed as one "telemetry" line
+each. At the end the bytes taken by text, log frames and telemetry
+frames are written to stderr, to compare the cost of each on the wire.
+
+Usage: applog_decode.py [capture.bin]
+"""
+
+import struct
+import sys
+
+SYNC = 0xA5
+FRAME_LEN = 8
+
+TELEMETRY_SYNC = 0x5A
+TELEMETRY_VERSION = 1
+TELEMETRY_HEADER_LEN = 7
+
+# Same order and prices as the catalog table in src/catalog.c
+PRODUCTS = {
+    1: ("Beer", 150),
+    2: ("Tuna sandwich", 100),
+    3: ("Coffee", 50),
+}
+
+# Same order as the states in src/machine.c
+STATES = [
+    "IDLE", "BROWSE_UP", "BROWSE_DOWN", "DISPENSING", "RETURNING",
+    "CENT10", "CENT20", "CENT50", "CENT100", "COMPARISON",
+    "ERROR", "OK", "DISPENSE", "PAYOUT", "VENDED",
+]
+
+
+def eur(cents):
+    return "%d.%d" % (cents // 100, cents % 100)
+
+
+def price(cents):
+    return "%d.%02d" % (cents // 100, cents % 100)
+
+
+def format_record(msg_id, product, credit):
+    name, cost = PRODUCTS.get(product, ("product %d" % product, 0))
+    if msg_id == 0:
+        return "%s: %s EUR\nCredit: %s EUR\n" % (name, price(cost), eur(credit))
+    if msg_id == 1:
+        return "Credit: %s EUR\n" % eur(credit)
+    if msg_id == 2:
+        return "%s EUR credit return\n" % eur(credit)
+    if msg_id == 3:
+        return "Product %s sold out, credit is %s EUR\n" % (name, eur(credit))
+    if msg_id == 4:
+        return "Not enough credit, product %s cost %s EUR, credit is %s EUR\n" % (
+            name, price(cost), eur(credit))
+    if msg_id == 5:
+        return "Product %s dispensed, remaining credit %s EUR\n" % (name, eur(credit))
+    if msg_id == 6:
+        return "%s EUR change\n" % eur(credit)
+    if msg_id == 7:
+        return "Exact change only\n" if credit else "Change available\n"
+    if msg_id == 8:
+        state = STATES[product] if 0 <= product < len(STATES) else "?"
+        return "State %s, credit %s EUR\n" % (state, eur(credit))
+    if msg_id == 9:
+        return "Dispenser busy, product %s not sold, credit is %s EUR\n" % (name, eur(credit))
+    return "<unknown message %d>\n" % msg_id
+
+
+def crc16_ccitt(seed, data):
+    """Same as crc16_ccitt() in Zephyr's sys/crc.h."""
+    for b in data:
+        e = (seed ^ b) & 0xFF
+        f = (e ^ (e << 4)) & 0xFF
+        seed = ((seed >> 8) ^ (f << 8) ^ (f << 3) ^ (f >> 4)) & 0xFFFF
+    return seed
+
+
+def telemetry_frame(data, i):
+    """Return (text, length) of the telemetry frame at i, or None."""
+    if i + TELEMETRY_HEADER_LEN > len(data) or data[i + 1] != TELEMETRY_VERSION:
+        return None
+    length = TELEMETRY_HEADER_LEN + data[i + 2] + 2
+    if i + length > len(data):
+        return None
+    crc, = struct.unpack_from("<H", data, i + length - 2)
+    if crc != crc16_ccitt(0, data[i + 1:i + length - 2]):
+        return None
+    seq, = struct.unpack_from("<I", data, i + 3)
+    words = struct.unpack_from("<%dI" % (data[i + 2] // 4), data, i + TELEMETRY_HEADER_LEN)
+    n = len(PRODUCTS)
+    vends, revenue, coins = words[:n], words[n], words[n + 1:n + 5]
+    no_credit, sold_out, refunds, refunded = words[n + 5:n + 9]
+    text = "telemetry seq=%d vends=%s revenue=%s coins=%s refused=%d+%d refunds=%d (%s EUR)\n" % (
+        seq, "/".join(map(str, vends)), eur(revenue), "/".join(map(str, coins)),
+        no_credit, sold_out, refunds, eur(refunded))
+    return text, length
+
+
+def decode(data, out):
+    i = 0
+    frames = 0
+    telemetry = 0
+    telemetry_bytes = 0
+    while i < len(data):
+        frame = telemetry_frame(data, i) if data[i] == TELEMETRY_SYNC else None
+        if frame is not None:
+            out.write(frame[0])
+            telemetry += 1
+            telemetry_bytes += frame[1]
+            i += frame[1]
+        elif data[i] == SYNC and i + FRAME_LEN <= len(data):
+            msg_id, product, credit = struct.unpack_from("<Bhi", data, i + 1)
+            out.write(format_record(msg_id, product, credit))
+            frames += 1
+            i += FRAME_LEN
+        else:
+            out.write(chr(data[i]))
+            i += 1
+    return frames, telemetry, telemetry_bytes
+
+
+def main():
+    if len(sys.argv) > 1:
+        with open(sys.argv[1], "rb") as f:
+            data = f.read()
+    else:
+        data = sys.stdin.buffer.read()
+    frames, telemetry, telemetry_bytes = decode(data, sys.stdout)
+    text_bytes = len(data) - frames * FRAME_LEN - telemetry_bytes
+    sys.stderr.write("%d bytes: %d text, %d log frames (%d bytes), %d telemetry frames (%d bytes)\n" % (
+        len(data), text_bytes, frames, frames * FRAME_LEN, telemetry, telemetry_bytes))
+
+
+if __name__ == "__main__":
+    main()
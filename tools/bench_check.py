@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+"""Check the BENCH lines of a console log against stored baselines.
+
+Reads the output of tests/benchmarks/fsm or of its host run (a file,
+or stdin with -), takes the median cycles of every benchmark and
+compares it with the baseline of the same board in the baseline file.
+A benchmark regresses when its median is above the baseline by more
+than its threshold in percent; the thresholds are per benchmark, with
+a default, and a board can override them in "board_thresholds" (the
+"host" board of tools/host_test shares its CPU with everything else
+and needs wider ones than a target).
+
+Usage: bench_check.py LOG [--baseline FILE] [--json OUT] [--update]
+
+The exit status is 1 if a benchmark regresses, and 2 if the board
+has no stored baselines: a run with nothing to compare against is
+not a pass. With --json the results are also written as JSON. With
+--update the medians of this run become the baselines of the board;
+do it on the first run on a board, from a quiet machine, and when a
+change in speed is intended.
+"""
+
+import argparse
+import json
+import re
+import sys
+
+BEGIN_RE = re.compile(r"BENCH_BEGIN board=(\S+) freq=(\d+) runs=(\d+)")
+BENCH_RE = re.compile(r"BENCH (\S+) min=(\d+) med=(\d+) max=(\d+)")
+
+
+def parse(lines):
+    board, freq, runs = None, 0, 0
+    results = {}
+    for line in lines:
+        m = BEGIN_RE.search(line)
+        if m:
+            board, freq, runs = m.group(1), int(m.group(2)), int(m.group(3))
+            results = {}
+            continue
+        m = BENCH_RE.search(line)
+        if m:
+            results[m.group(1)] = {"min": int(m.group(2)), "med": int(m.group(3)),
+                                   "max": int(m.group(4))}
+            continue
+        if "BENCH_END" in line and board is not None:
+            return board, freq, runs, results
+    sys.exit("No complete BENCH_BEGIN ... BENCH_END block in the log")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("log")
+    parser.add_argument("--baseline", default="tools/bench_baseline.json")
+    parser.add_argument("--json")
+    parser.add_argument("--update", action="store_true")
+    args = parser.parse_args()
+
+    if args.log == "-":
+        board, freq, runs, results = parse(sys.stdin)
+    else:
+        with open(args.log, encoding="utf-8", errors="replace") as f:
+            board, freq, runs, results = parse(f)
+
+    with open(args.baseline, encoding="utf-8") as f:
+        stored = json.load(f)
+    thresholds = stored.get("thresholds", {})
+    board_thresholds = stored.get("board_thresholds", {}).get(board, {})
+    baselines = stored.setdefault("baselines", {}).get(board, {})
+
+    regressions = []
+    print("Board %s, %d Hz, %d runs" % (board, freq, runs))
+    print("%-18s %8s %8s %8s %9s %7s" % ("benchmark", "min", "median", "max", "baseline", "delta"))
+    for name, r in results.items():
+        base = baselines.get(name)
+        limit = board_thresholds.get(name, board_thresholds.get(
+            "default", thresholds.get(name, thresholds.get("default", 10))))
+        r["baseline"] = base
+        r["threshold"] = limit
+        if base:
+            delta = 100.0 * (r["med"] - base) / base
+            r["delta"] = round(delta, 1)
+            if delta > limit:
+                regressions.append("%s median %d > %d + %d%%" % (name, r["med"], base, limit))
+            print("%-18s %8d %8d %8d %9d %+6.1f%%" % (name, r["min"], r["med"], r["max"], base, delta))
+        else:
+            print("%-18s %8d %8d %8d %9s %7s" % (name, r["min"], r["med"], r["max"], "-", "new"))
+
+    if args.json:
+        with open(args.json, "w", encoding="utf-8") as f:
+            json.dump({"board": board, "freq": freq, "runs": runs, "results": results,
+                       "regressions": regressions}, f, indent=4)
+            f.write("\n")
+
+    if args.update:
+        stored["baselines"][board] = {name: r["med"] for name, r in results.items()}
+        with open(args.baseline, "w", encoding="utf-8") as f:
+            json.dump(stored, f, indent=4, sort_keys=True)
+            f.write("\n")
+        print("Baselines of %s written to %s" % (board, args.baseline))
+        return 0
+
+    if not baselines:
+        sys.stderr.write("No baselines for board %s in %s, nothing checked; "
+                         "record them with --update\n" % (board, args.baseline))
+        return 2
+    for msg in regressions:
+        sys.stderr.write("Benchmark regression: %s\n" % msg)
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
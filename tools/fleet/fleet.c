@@ -0,0 +1,460 @@
+/** @file fleet.c
+ * @brief Fleet simulator: many vending machines on the host
+ *
+ * Runs thousands of machines built from the same
+ * machine.c, fsm.c, catalog.c and change.c as the
+ * board, split across host threads. Customers
+ * arrive at each machine as a Poisson process;
+ * each one browses to a product, inserts coins
+ * until the credit covers the price, selects it
+ * and sometimes asks for the credit back. The
+ * dispenser is modeled with the queue length and
+ * stage times of dispenser.h. The slots are
+ * refilled at a fixed period of simulated time.
+ *
+ * The same fleet is simulated once per thread
+ * count, 1, 2, 4 ... up to -t, and the wall time
+ * gives the aggregate transactions per second
+ * and the scaling with the number of threads.
+ *
+ * Usage: fleet [-m machines] [-t threads] [-H hours]
+ *              [-r customers per hour] [-f refill hours] [-s seed]
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dispenser.h"
+#include "machine.h"
+
+#define FLEET_CACHE_LINE 64 /* Per thread data is aligned to it, no false sharing */
+#define FLEET_VEND_S ((DISPENSER_RESERVE_MS + DISPENSER_ACTUATE_MS + DISPENSER_CONFIRM_MS) / 1000.0)
+#define FLEET_PRESS_S 1.0 /* Time between two presses of a customer */
+#define FLEET_WALK_AWAY 10 /* Percent of customers who take the credit back without buying */
+#define FLEET_RETURN 50 /* Percent of buyers who ask for the credit left */
+
+/* Options */
+static unsigned n_machines = 4096;
+static unsigned max_threads;
+static double hours = 24.0;
+static double rate = 5.0;
+static double refill_h = 12.0;
+static uint64_t seed = 1;
+
+/* Simulated machine: the machine and its dispenser */
+struct sim_machine {
+    struct machine m;
+    double vend_done[DISPENSER_QUEUE_LEN]; /* Completion time of each queued vend */
+    uint8_t vend_prod[DISPENSER_QUEUE_LEN]; /* Product of each queued vend */
+    uint8_t head; /* Oldest queued vend */
+    uint8_t queued; /* Vends in the queue */
+    double now; /* Simulated time of the machine, in seconds */
+};
+
+/* Counters of a thread, summed at the end */
+struct fleet_stats {
+    uint64_t customers; /* Customers served */
+    uint64_t events; /* Events stepped, EV_VEND_DONE included */
+    uint64_t sales; /* Products sold */
+    uint64_t refused; /* Selections refused */
+    uint64_t refunds; /* Refunds paid */
+    uint64_t logs; /* Messages for the display */
+    uint64_t inserted; /* Cents inserted */
+    uint64_t accounted; /* Cents of credit, spent and returned */
+};
+
+/* A simulation thread */
+struct fleet_thread {
+    pthread_t tid;
+    struct sim_machine *machines; /* Machines owned by the thread */
+    unsigned n; /* Number of machines */
+    unsigned first; /* Index of the first machine in the fleet */
+    uint64_t rng; /* State of xorshift64, seeded again for each machine */
+    struct fleet_stats stats;
+} __attribute__((aligned(FLEET_CACHE_LINE)));
+
+/**
+ * @brief rng_next function next number of the xorshift64 generator
+ *
+ * @param s state of the generator
+ * @return random 64 bit number
+ */
+
+static uint64_t rng_next(uint64_t *s){
+    uint64_t x = *s;
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *s = x;
+    return x;
+}
+
+/**
+ * @brief rng_seed function state of the generator of a machine
+ *
+ * splitmix64 of the seed and the machine index,
+ * so every machine sees the same customers
+ * whatever the number of threads.
+ *
+ * @param machine index of the machine in the fleet
+ * @return state for rng_next(), never zero
+ */
+
+static uint64_t rng_seed(uint64_t machine){
+    uint64_t z = seed * 0x9E3779B97F4A7C15ull + machine;
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    z ^= z >> 31;
+    return z != 0 ? z : 1;
+}
+
+/**
+ * @brief rng_uniform function uniform number in [0, 1)
+ *
+ * @param s state of the generator
+ * @return random number
+ */
+
+static double rng_uniform(uint64_t *s){
+    return (rng_next(s) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * @brief rng_exp function exponential interarrival time
+ *
+ * @param s state of the generator
+ * @param per_s mean arrivals per second
+ * @return time to the next arrival, in seconds
+ */
+
+static double rng_exp(uint64_t *s, double per_s){
+    return -log(1.0 - rng_uniform(s)) / per_s;
+}
+
+/**
+ * @brief sim_log function count the messages of a machine
+ *
+ * @param m machine
+ * @param id message id (APPLOG_xxx)
+ * @param product product the message refers to
+ * @param credit credit or amount in cents
+ */
+
+static void sim_log(struct machine *m, uint8_t id, int16_t product, int32_t credit){
+    struct fleet_thread *t = m->user;
+
+    t->stats.logs++;
+}
+
+/**
+ * @brief sim_record function count the changes of a machine
+ *
+ * @param m machine
+ * @param type MACHINE_COIN_IN ... MACHINE_REFUND
+ * @param product selected product
+ * @param amount coin, price or refund in cents
+ * @param coins coins paid by a refund, NULL otherwise
+ */
+
+static void sim_record(struct machine *m, uint8_t type, int16_t product, int amount,
+                       const struct change_coins *coins){
+    struct fleet_thread *t = m->user;
+
+    switch (type) {
+    case MACHINE_VEND:
+        t->stats.sales++;
+        break;
+    case MACHINE_VEND_FAILED:
+        t->stats.refused++;
+        break;
+    case MACHINE_REFUND:
+        t->stats.refunds++;
+        break;
+    }
+}
+
+/**
+ * @brief sim_vend function queue a vend on the simulated dispenser
+ *
+ * @param m machine
+ * @param product product sold
+ */
+
+static void sim_vend(struct machine *m, uint8_t product){
+    struct sim_machine *sm = CONTAINER_OF(m, struct sim_machine, m);
+    uint8_t i = (sm->head + sm->queued) % DISPENSER_QUEUE_LEN;
+    double start = sm->now;
+
+    /* The motor runs one vend at a time */
+    if (sm->queued > 0) {
+        start = MAX(start, sm->vend_done[(i + DISPENSER_QUEUE_LEN - 1) % DISPENSER_QUEUE_LEN]);
+    }
+    sm->vend_done[i] = start + FLEET_VEND_S;
+    sm->vend_prod[i] = product;
+    sm->queued++;
+}
+
+/**
+ * @brief sim_busy function check the simulated dispenser queue
+ *
+ * @param m machine
+ * @return true if the queue is full
+ */
+
+static bool sim_busy(struct machine *m){
+    struct sim_machine *sm = CONTAINER_OF(m, struct sim_machine, m);
+
+    return sm->queued == DISPENSER_QUEUE_LEN;
+}
+
+static const struct machine_ops sim_ops = {
+    .log = sim_log,
+    .record = sim_record,
+    .vend = sim_vend,
+    .busy = sim_busy,
+};
+
+/**
+ * @brief sim_step function step a machine and count the event
+ *
+ * @param t thread
+ * @param sm machine
+ * @param event EV_UP ... EV_C100
+ */
+
+static void sim_step(struct fleet_thread *t, struct sim_machine *sm, uint8_t event){
+    machine_step(&sm->m, event);
+    t->stats.events++;
+    sm->now += FLEET_PRESS_S;
+}
+
+/**
+ * @brief sim_advance function complete the vends due at a time
+ *
+ * @param t thread
+ * @param sm machine
+ * @param until simulated time, in seconds
+ */
+
+static void sim_advance(struct fleet_thread *t, struct sim_machine *sm, double until){
+    while (sm->queued > 0 && sm->vend_done[sm->head] <= until) {
+        machine_vend_done(&sm->m, sm->vend_prod[sm->head]);
+        t->stats.events++;
+        sm->head = (sm->head + 1) % DISPENSER_QUEUE_LEN;
+        sm->queued--;
+    }
+}
+
+/**
+ * @brief sim_customer function one customer at a machine
+ *
+ * @param t thread
+ * @param sm machine
+ */
+
+static void sim_customer(struct fleet_thread *t, struct sim_machine *sm){
+    static const uint8_t coins[] = { EV_C10, EV_C20, EV_C50, EV_C50, EV_C100, EV_C100 };
+    int want = 1 + rng_next(&t->rng) % CATALOG_SIZE;
+    int price = catalog_get(want)->price;
+
+    while (sm->m.sel_prod < want) {
+        sim_step(t, sm, EV_UP);
+    }
+    while (sm->m.sel_prod > want) {
+        sim_step(t, sm, EV_DOWN);
+    }
+    while (sm->m.credit < price) {
+        int c = rng_next(&t->rng) % ARRAY_SIZE(coins);
+
+        sim_step(t, sm, coins[c]);
+    }
+    if (rng_next(&t->rng) % 100 < FLEET_WALK_AWAY) {
+        sim_step(t, sm, EV_RETURN);
+    } else {
+        sim_step(t, sm, EV_SELECT);
+        if (sm->m.credit > 0 && rng_next(&t->rng) % 100 < FLEET_RETURN) {
+            sim_step(t, sm, EV_RETURN);
+        }
+    }
+    t->stats.customers++;
+}
+
+/**
+ * @brief sim_refill function fill every slot of a machine
+ *
+ * @param sm machine
+ */
+
+static void sim_refill(struct sim_machine *sm){
+    uint16_t full[CATALOG_SIZE];
+
+    for (int i = 0; i < CATALOG_SIZE; i++) {
+        full[i] = catalog_get(i + 1)->stock;
+    }
+    catalog_restore(&sm->m.catalog, full);
+}
+
+/**
+ * @brief fleet_thread function simulate the machines of a thread
+ *
+ * Each machine runs to the end of the
+ * simulated period before the next one, since
+ * machines do not interact.
+ *
+ * @param arg struct fleet_thread
+ */
+
+static void *fleet_thread(void *arg){
+    struct fleet_thread *t = arg;
+    double end = hours * 3600.0;
+    double per_s = rate / 3600.0;
+
+    for (unsigned i = 0; i < t->n; i++) {
+        struct sim_machine *sm = &t->machines[i];
+        double next_refill = refill_h * 3600.0;
+        struct vending_totals totals;
+
+        t->rng = rng_seed(t->first + i);
+        machine_init(&sm->m, &sim_ops, t);
+        sm->head = 0;
+        sm->queued = 0;
+        sm->now = 0.0;
+        for (double at = rng_exp(&t->rng, per_s); at < end; at += rng_exp(&t->rng, per_s)) {
+            sm->now = MAX(sm->now, at);
+            sim_advance(t, sm, sm->now);
+            if (sm->now >= next_refill) {
+                sim_refill(sm);
+                next_refill += refill_h * 3600.0;
+            }
+            sim_customer(t, sm);
+        }
+        sim_advance(t, sm, INFINITY);
+
+        machine_totals_get(&sm->m, &totals);
+        t->stats.inserted += totals.inserted;
+        t->stats.accounted += totals.credit + totals.spent + totals.returned;
+    }
+    return NULL;
+}
+
+/**
+ * @brief fleet_run function simulate the fleet with some threads
+ *
+ * @param n_threads number of threads
+ * @param sum counters of all the threads
+ * @return wall time in seconds
+ */
+
+static double fleet_run(unsigned n_threads, struct fleet_stats *sum){
+    struct fleet_thread *threads;
+    struct timespec t0, t1;
+    unsigned first = 0;
+
+    threads = aligned_alloc(FLEET_CACHE_LINE, n_threads * sizeof(*threads));
+    memset(threads, 0, n_threads * sizeof(*threads));
+    for (unsigned i = 0; i < n_threads; i++) {
+        struct fleet_thread *t = &threads[i];
+
+        t->n = n_machines / n_threads + (i < n_machines % n_threads);
+        t->machines = calloc(t->n, sizeof(struct sim_machine));
+        t->first = first;
+        first += t->n;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (unsigned i = 0; i < n_threads; i++) {
+        pthread_create(&threads[i].tid, NULL, fleet_thread, &threads[i]);
+    }
+    memset(sum, 0, sizeof(*sum));
+    for (unsigned i = 0; i < n_threads; i++) {
+        const struct fleet_stats *s = &threads[i].stats;
+
+        pthread_join(threads[i].tid, NULL);
+        sum->customers += s->customers;
+        sum->events += s->events;
+        sum->sales += s->sales;
+        sum->refused += s->refused;
+        sum->refunds += s->refunds;
+        sum->logs += s->logs;
+        sum->inserted += s->inserted;
+        sum->accounted += s->accounted;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    for (unsigned i = 0; i < n_threads; i++) {
+        free(threads[i].machines);
+    }
+    free(threads);
+    return (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+}
+
+/**
+ * @brief main function parse the options and run the thread counts
+ *
+ * @return 0, 1 if the money check fails, 2 for a bad option
+ */
+
+int main(int argc, char **argv){
+    struct fleet_stats s;
+    double base_tps = 0.0;
+    int opt;
+
+    max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    while ((opt = getopt(argc, argv, "m:t:H:r:f:s:")) != -1) {
+        switch (opt) {
+        case 'm': n_machines = strtoul(optarg, NULL, 0); break;
+        case 't': max_threads = strtoul(optarg, NULL, 0); break;
+        case 'H': hours = strtod(optarg, NULL); break;
+        case 'r': rate = strtod(optarg, NULL); break;
+        case 'f': refill_h = strtod(optarg, NULL); break;
+        case 's': seed = strtoull(optarg, NULL, 0); break;
+        default:
+            fprintf(stderr, "Usage: %s [-m machines] [-t threads] [-H hours] "
+                    "[-r customers per hour] [-f refill hours] [-s seed]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (n_machines == 0 || max_threads == 0 || rate <= 0.0 || refill_h <= 0.0) {
+        fprintf(stderr, "Machines, threads, rate and refill period must be positive\n");
+        return 2;
+    }
+
+    catalog_init();
+    change_init();
+    printf("Fleet: %u machines, %.1f h, %.1f customers/h, refill every %.1f h, seed %llu\n",
+           n_machines, hours, rate, refill_h, (unsigned long long)seed);
+    printf("%7s %10s %11s %10s %8s %12s %12s %8s %6s\n", "threads", "customers", "events",
+           "sales", "refused", "tps", "events/s", "speedup", "eff");
+
+    for (unsigned n = 1; ; n = MIN(n * 2, max_threads)) {
+        double wall = fleet_run(n, &s);
+        double tps = s.customers / wall;
+
+        if (n == 1) {
+            base_tps = tps;
+        }
+        printf("%7u %10llu %11llu %10llu %8llu %12.0f %12.0f %8.2f %5.0f%%\n", n,
+               (unsigned long long)s.customers, (unsigned long long)s.events,
+               (unsigned long long)s.sales, (unsigned long long)s.refused, tps,
+               s.events / wall, tps / base_tps, 100.0 * tps / base_tps / n);
+        if (s.inserted != s.accounted) {
+            printf("Money check failed: %llu cents inserted, %llu accounted\n",
+                   (unsigned long long)s.inserted, (unsigned long long)s.accounted);
+            return 1;
+        }
+        if (n == max_threads) {
+            break;
+        }
+    }
+    return 0;
+}
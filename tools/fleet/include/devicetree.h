@@ -0,0 +1,14 @@
+/** @file devicetree.h
+ * @brief Host replacement of the devicetree macros used by vending.h
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#ifndef FLEET_DEVICETREE_H
+#define FLEET_DEVICETREE_H
+
+#define DT_NODELABEL(label) label
+
+#endif /* FLEET_DEVICETREE_H */
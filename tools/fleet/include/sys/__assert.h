@@ -0,0 +1,16 @@
+/** @file __assert.h
+ * @brief Host replacement of the Zephyr assertions
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#ifndef FLEET_ASSERT_H
+#define FLEET_ASSERT_H
+
+#include <assert.h>
+
+#define __ASSERT_NO_MSG(test) assert(test)
+
+#endif /* FLEET_ASSERT_H */
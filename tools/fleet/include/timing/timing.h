@@ -0,0 +1,47 @@
+/** @file timing.h
+ * @brief Host replacement of the Zephyr timing API
+ *
+ * Cycles are nanoseconds of the monotonic clock.
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#ifndef FLEET_TIMING_H
+#define FLEET_TIMING_H
+
+#include <stdint.h>
+#include <time.h>
+
+typedef uint64_t timing_t;
+
+static inline void timing_init(void){
+}
+
+static inline void timing_start(void){
+}
+
+static inline void timing_stop(void){
+}
+
+static inline uint64_t timing_freq_get(void){
+    return 1000000000u;
+}
+
+static inline timing_t timing_counter_get(void){
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static inline uint64_t timing_cycles_get(volatile timing_t *const start, volatile timing_t *const end){
+    return *end - *start;
+}
+
+static inline uint64_t timing_cycles_to_ns(uint64_t cycles){
+    return cycles;
+}
+
+#endif /* FLEET_TIMING_H */
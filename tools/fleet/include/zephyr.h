@@ -0,0 +1,33 @@
+/** @file zephyr.h
+ * @brief Host replacement of the Zephyr definitions used by the machine
+ *
+ * Only what machine.c, fsm.c, catalog.c and
+ * change.c need, so that they build unchanged
+ * for the fleet simulator.
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#ifndef FLEET_ZEPHYR_H
+#define FLEET_ZEPHYR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sys/__assert.h>
+
+#ifndef MIN
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+#endif
+#define BIT(n) (1UL << (n))
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define CONTAINER_OF(ptr, type, field) ((type *)(((char *)(ptr)) - offsetof(type, field)))
+#define BUILD_ASSERT(cond, ...) _Static_assert(cond, "")
+
+#endif /* FLEET_ZEPHYR_H */
@@ -0,0 +1,166 @@
+#!/usr/bin/env python3
+"""ROM/RAM footprint of a Zephyr image by module, checked against budgets.
+
+Reads zephyr.map, assigns every input section to a module from the path
+of its object file (app, kernel, drivers, libc, cbprintf, arch, subsys,
+hal, other) and to ROM or RAM from its run address. A section that runs
+in RAM but is loaded from flash (the initializers of .data and of the
+kernel object areas) is counted in both: in RAM where it runs and in
+ROM for the copy that startup code reads, as it takes flash too.
+Merged strings are listed with their size before merging, at the same
+address as the next section: only the bytes past the end of the
+previous input section are counted.
+
+Usage: footprint.py zephyr.map [--budget FILE] [--update]
+
+With --budget the script exits with status 1 if a module is over its
+budget. With --update the budgets are rewritten from this image, with
+5% headroom, and the "_source" key records the map they come from; do
+it when a size increase is intended.
+"""
+
+import argparse
+import json
+import re
+import sys
+
+HEADROOM = 1.05
+
+# First match wins, cbprintf lives in lib/os and must come before libc
+MODULES = [
+    ("cbprintf", re.compile(r"cbprintf")),
+    ("app", re.compile(r"app\.dir|libapp\.a")),
+    ("kernel", re.compile(r"/kernel/|libkernel\.a")),
+    ("libc", re.compile(r"libc|newlib|picolibc|libgcc|libm\.a")),
+    ("drivers", re.compile(r"/drivers/|libdrivers__")),
+    ("arch", re.compile(r"/arch/|libarch__|isr_tables|libzephyr\.a\(.*(cpu|reset|vector)")),
+    ("subsys", re.compile(r"/subsys/|libsubsys__|liblib__")),
+    ("hal", re.compile(r"modules|nrfx|hal_")),
+]
+
+NOT_LOADED = (".debug", ".comment", ".ARM.attributes", ".stab", "/DISCARD/")
+
+INPUT_RE = re.compile(r"^\s+(?:(\S+)\s+)?0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(\S.*)$")
+NAME_ONLY_RE = re.compile(r"^\s(\S+)$")
+REGION_RE = re.compile(r"^(\S+)\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)")
+LOAD_RE = re.compile(r"load address 0x([0-9a-fA-F]+)")
+
+
+def module_of(path):
+    for name, pattern in MODULES:
+        if pattern.search(path):
+            return name
+    return "other"
+
+
+def region_of(regions, addr):
+    for kind, origin, length in regions:
+        if origin <= addr < origin + length:
+            return kind
+    return None
+
+
+def parse(map_file):
+    regions = []
+    sizes = {}
+    in_memory = False
+    in_layout = False
+    output = ""
+    load = None  # Region the current output section is loaded from, if not its run region
+    end = 0  # End of the last input section counted
+
+    with open(map_file, encoding="utf-8", errors="replace") as f:
+        for line in f:
+            line = line.rstrip("\n")
+            if line.startswith("Memory Configuration"):
+                in_memory = True
+                continue
+            if line.startswith("Linker script and memory map"):
+                in_memory = False
+                in_layout = True
+                continue
+            if in_memory:
+                m = REGION_RE.match(line)
+                if m and m.group(1) != "Name" and not m.group(1).startswith("*"):
+                    name = m.group(1).upper()
+                    kind = "rom" if "FLASH" in name else "ram" if "RAM" in name else None
+                    if kind:
+                        regions.append((kind, int(m.group(2), 16), int(m.group(3), 16)))
+                continue
+            if not in_layout or not line:
+                continue
+            if not line[0].isspace():
+                output = line.split()[0]
+                load = None
+                end = 0
+            m = LOAD_RE.search(line)
+            if m:
+                # Output section header, on its own line or after the name
+                load = region_of(regions, int(m.group(1), 16))
+                continue
+            if not line[0].isspace():
+                continue
+            if output.startswith(NOT_LOADED) or NAME_ONLY_RE.match(line):
+                continue
+            m = INPUT_RE.match(line)
+            if not m or m.group(1) == "*fill*":
+                continue
+            addr, size, path = int(m.group(2), 16), int(m.group(3), 16), m.group(4)
+            start = max(addr, end)
+            size = addr + size - start
+            if size <= 0:
+                continue
+            end = start + size
+            kind = region_of(regions, addr)
+            if kind is None:
+                continue
+            entry = sizes.setdefault(module_of(path), {"rom": 0, "ram": 0})
+            entry[kind] += size
+            if load == "rom" and kind == "ram":
+                entry["rom"] += size
+    return sizes
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("map")
+    parser.add_argument("--budget")
+    parser.add_argument("--update", action="store_true")
+    args = parser.parse_args()
+
+    sizes = parse(args.map)
+    budget = {}
+    if args.budget and not args.update:
+        with open(args.budget, encoding="utf-8") as f:
+            budget = json.load(f)
+
+    over = []
+    print("%-10s %8s %8s %10s %10s" % ("module", "ROM", "RAM", "ROM budget", "RAM budget"))
+    for name in sorted(sizes, key=lambda n: -sizes[n]["rom"]):
+        limits = budget.get(name, {})
+        print("%-10s %8d %8d %10s %10s" % (name, sizes[name]["rom"], sizes[name]["ram"],
+                                           limits.get("rom", "-"), limits.get("ram", "-")))
+        for kind in ("rom", "ram"):
+            if kind in limits and sizes[name][kind] > limits[kind]:
+                over.append("%s %s %d > %d" % (name, kind.upper(), sizes[name][kind], limits[kind]))
+    print("%-10s %8d %8d" % ("total", sum(s["rom"] for s in sizes.values()),
+                             sum(s["ram"] for s in sizes.values())))
+
+    if args.update and args.budget:
+        new = {"_source": "Measured: tools/footprint.py on %s, plus %d%%." % (
+            args.map, round((HEADROOM - 1) * 100))}
+        new.update({name: {kind: int(size * HEADROOM) for kind, size in s.items()}
+                    for name, s in sorted(sizes.items())})
+        with open(args.budget, "w", encoding="utf-8") as f:
+            json.dump(new, f, indent=4)
+            f.write("\n")
+        print("Budgets written to %s" % args.budget)
+        return 0
+
+    for msg in over:
+        sys.stderr.write("Footprint over budget: %s\n" % msg)
+    return 1 if over else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
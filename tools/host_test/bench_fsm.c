@@ -0,0 +1,35 @@
+/** @file bench_fsm.c
+ * @brief Host run of the state machine benchmarks
+ *
+ * Runs tests/benchmarks/fsm/src/bench.c on the
+ * host, with the monotonic clock in ns as the
+ * timing API, and prints the same BENCH block as
+ * the ztest suite, board "host".
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "bench.h"
+
+/**
+ * @brief host_printk function printk of the benchmarks, sent to stdout
+ *
+ * @param fmt printf format
+ */
+
+void host_printk(const char *fmt, ...){
+    va_list ap;
+
+    va_start(ap, fmt);
+    vprintf(fmt, ap);
+    va_end(ap);
+}
+
+int main(void){
+    return bench_run() ? 1 : 0;
+}
@@ -0,0 +1,206 @@
+/** @file dispatch_bench.c
+ * @brief Host comparison of the polling loop and the dispatcher
+ *
+ * Runs the input path of main.c both ways on the
+ * host, on the real input_ring.c and machine.c: a
+ * producer thread stands for the debounce ISR and
+ * puts presses in the ring, a consumer thread
+ * stands for the input thread and steps a machine
+ * with them. The consumer either wakes up every
+ * DISPATCH_POLL_MS as the original main loop did,
+ * or blocks on a semaphore given after every put
+ * as the dispatcher does.
+ *
+ * For each loop it prints the wakeups per second
+ * while idle and, over the same pseudo random
+ * presses, the wakeups and the press-to-output
+ * latency (put to machine_step returned). Host
+ * threads are scheduled by Linux, not by Zephyr:
+ * the numbers compare the two loops, they are not
+ * the latency of the board.
+ *
+ * Usage: dispatch_bench [presses]
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "catalog.h"
+#include "change.h"
+#include "input_ring.h"
+#include "machine.h"
+
+#define DISPATCH_POLL_MS 5 /* Period of the original main loop */
+#define DISPATCH_IDLE_MS 2000 /* Idle time over which the wakeups are counted */
+#define DISPATCH_GAP_MIN_MS 10 /* Shortest gap between two presses */
+#define DISPATCH_GAP_MAX_MS 40 /* Longest gap between two presses */
+#define DISPATCH_PRESSES 200 /* Default number of presses */
+#define DISPATCH_MAX_PRESSES 10000 /* Latencies kept for the percentiles */
+
+/* One run of a loop */
+struct dispatch_run {
+    bool poll; /* Poll every DISPATCH_POLL_MS instead of blocking */
+    volatile bool stop; /* Set by the producer when the run is over */
+    sem_t sem; /* Given by the producer after every put */
+    struct machine m; /* Machine stepped by the consumer */
+    uint32_t wakeups; /* Wakeups of the consumer */
+    uint32_t handled; /* Presses handled */
+    uint32_t latency_ns[DISPATCH_MAX_PRESSES]; /* Press-to-output latency of every press */
+};
+
+static void dispatch_vend(struct machine *m, uint8_t product);
+
+/* Only the dispenser is modeled */
+static const struct machine_ops dispatch_ops = {
+    .vend = dispatch_vend,
+};
+
+static unsigned presses = DISPATCH_PRESSES;
+static uint8_t sold; /* Product handed to the dispenser by the last press, 0 if none */
+
+/**
+ * @brief host_printk function printk of the app modules, dropped
+ *
+ * @param fmt printf format
+ */
+
+void host_printk(const char *fmt, ...){
+}
+
+/**
+ * @brief dispatch_vend function take a sold product
+ *
+ * @param m machine of the run
+ * @param product product sold
+ */
+
+static void dispatch_vend(struct machine *m, uint8_t product){
+    sold = product;
+}
+
+/**
+ * @brief sleep_ms function sleep the calling thread
+ *
+ * @param ms time to sleep
+ */
+
+static void sleep_ms(unsigned ms){
+    struct timespec ts = { .tv_sec = ms / 1000, .tv_nsec = (ms % 1000) * 1000000L };
+
+    while (nanosleep(&ts, &ts) != 0) {
+    }
+}
+
+/**
+ * @brief consumer function the input thread, polling or blocking
+ *
+ * @param arg dispatch_run of the loop
+ * @return NULL
+ */
+
+static void *consumer(void *arg){
+    struct dispatch_run *run = arg;
+    struct input_event ev;
+
+    while (!run->stop) {
+        if (run->poll) {
+            sleep_ms(DISPATCH_POLL_MS);
+        } else {
+            sem_wait(&run->sem);
+        }
+        run->wakeups++;
+        while (input_ring_get(&ev)) {
+            machine_step(&run->m, ev.pin);
+            timing_t now = timing_counter_get();
+
+            if (run->handled < DISPATCH_MAX_PRESSES) {
+                run->latency_ns[run->handled] = (uint32_t)timing_cycles_get(&ev.timestamp, &now);
+            }
+            run->handled++;
+            if (sold != 0) {
+                machine_vend_done(&run->m, sold);
+                sold = 0;
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief cmp_u32 function order two latencies for qsort
+ *
+ * @param a first latency
+ * @param b second latency
+ * @return <0, 0 or >0 as a is below, equal or above b
+ */
+
+static int cmp_u32(const void *a, const void *b){
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief dispatch_measure function run one loop and print its numbers
+ *
+ * @param run loop to measure
+ */
+
+static void dispatch_measure(struct dispatch_run *run){
+    unsigned seed = 1; /* Same presses for both loops */
+    uint32_t idle_wakeups, busy_wakeups;
+    uint64_t total = 0;
+    pthread_t tid;
+
+    machine_init(&run->m, &dispatch_ops, NULL);
+    run->m.fsm.timed = false;
+    sem_init(&run->sem, 0, 0);
+    pthread_create(&tid, NULL, consumer, run);
+
+    sleep_ms(DISPATCH_IDLE_MS);
+    idle_wakeups = run->wakeups;
+
+    for (unsigned i = 0; i < presses; i++) {
+        sleep_ms(DISPATCH_GAP_MIN_MS + rand_r(&seed) % (DISPATCH_GAP_MAX_MS - DISPATCH_GAP_MIN_MS + 1));
+        input_ring_put(rand_r(&seed) % 8, timing_counter_get()); /* EV_UP ... EV_C100 */
+        sem_post(&run->sem);
+    }
+    sleep_ms(DISPATCH_GAP_MAX_MS);
+    busy_wakeups = run->wakeups - idle_wakeups;
+    run->stop = true;
+    sem_post(&run->sem);
+    pthread_join(tid, NULL);
+
+    uint32_t n = MIN(run->handled, DISPATCH_MAX_PRESSES);
+
+    qsort(run->latency_ns, n, sizeof(run->latency_ns[0]), cmp_u32);
+    for (uint32_t i = 0; i < n; i++) {
+        total += run->latency_ns[i];
+    }
+    printf("%-6s idle %4u wakeups/s, %u presses, %u wakeups, latency avg %u us p50 %u us p99 %u us max %u us\n",
+           run->poll ? "poll" : "block", idle_wakeups * 1000 / DISPATCH_IDLE_MS, run->handled,
+           busy_wakeups, (uint32_t)(total / n / 1000), run->latency_ns[n / 2] / 1000,
+           run->latency_ns[n * 99 / 100] / 1000, run->latency_ns[n - 1] / 1000);
+    sem_destroy(&run->sem);
+}
+
+int main(int argc, char **argv){
+    static struct dispatch_run poll_run = { .poll = true };
+    static struct dispatch_run block_run = { .poll = false };
+
+    if (argc > 1) {
+        presses = MAX(1, MIN(atoi(argv[1]), DISPATCH_MAX_PRESSES));
+    }
+    catalog_init();
+    change_init();
+    dispatch_measure(&poll_run);
+    dispatch_measure(&block_run);
+    return 0;
+}
@@ -0,0 +1,174 @@
+/** @file display_test.c
+ * @brief Host test of the change-only display output
+ *
+ * The frames of display.c are played on a small
+ * terminal model that knows the escapes they use
+ * (ESC [ 2 J, ESC [ row ; col H, ESC [ K); after
+ * every frame the terminal must show the model.
+ * The rows that get shorter while their end still
+ * matches the old row are tested on their own,
+ * then a seeded stream of records is checked.
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../src/display.c"
+
+#define TEST_RECORDS 100000 /* Records of the seeded stream */
+#define TEST_SEED 12345 /* Seed of the stream */
+
+static char screen[DISPLAY_ROWS][DISPLAY_COLS + 1]; /* What the terminal shows */
+static int cur_row, cur_col; /* Cursor of the terminal */
+static int failures; /* Checks failed */
+
+/* The text lines are not under test */
+int applog_format(const struct applog_record *rec, char *line, size_t size){
+    return 0;
+}
+
+/**
+ * @brief term_put function play bytes on the terminal model
+ *
+ * @param s bytes sent by the display
+ */
+
+static void term_put(const char *s){
+    while (*s) {
+        if (s[0] == '\x1b' && s[1] == '[') {
+            int a = 0, b = 0;
+            const char *p = s + 2;
+
+            while (*p >= '0' && *p <= '9') {
+                a = a * 10 + *p++ - '0';
+            }
+            if (*p == ';') {
+                p++;
+                while (*p >= '0' && *p <= '9') {
+                    b = b * 10 + *p++ - '0';
+                }
+            }
+            switch (*p) {
+            case 'J':
+                memset(screen, 0, sizeof(screen));
+                break;
+            case 'H':
+                cur_row = a - 1;
+                cur_col = b - 1;
+                break;
+            case 'K':
+                memset(&screen[cur_row][cur_col], 0, DISPLAY_COLS + 1 - cur_col);
+                break;
+            default:
+                printf("FAIL: unknown escape %c\n", *p);
+                failures++;
+                break;
+            }
+            s = p + 1;
+            continue;
+        }
+        /* Columns skipped by the cursor are blanks */
+        for (int col = strlen(screen[cur_row]); col < cur_col; col++) {
+            screen[cur_row][col] = ' ';
+        }
+        screen[cur_row][cur_col++] = *s++;
+    }
+}
+
+/**
+ * @brief host_printk function printk of display.c, sent to the terminal model
+ *
+ * @param fmt printf format
+ */
+
+void host_printk(const char *fmt, ...){
+    char buf[DISPLAY_FRAME_SIZE * 2];
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    term_put(buf);
+}
+
+/**
+ * @brief check_screen function compare the terminal with the model
+ *
+ * @param what test step, printed on a failure
+ */
+
+static void check_screen(const char *what){
+    for (int row = 0; row < DISPLAY_ROWS; row++) {
+        if (strcmp(screen[row], model[row]) != 0) {
+            printf("FAIL %s: row %d shows \"%s\", model \"%s\"\n", what, row,
+                   screen[row], model[row]);
+            failures++;
+        }
+    }
+}
+
+/**
+ * @brief check_row function show one row, then another
+ *
+ * @param before first content of the row
+ * @param after second content of the row
+ */
+
+static void check_row(const char *before, const char *after){
+    display_set(DISPLAY_STATUS, "%s", before);
+    display_flush();
+    check_screen(before);
+    display_set(DISPLAY_STATUS, "%s", after);
+    display_flush();
+    check_screen(after);
+}
+
+int main(void){
+    static const uint8_t ids[] = {
+        APPLOG_PRODUCT, APPLOG_CREDIT, APPLOG_RETURN, APPLOG_SOLD_OUT, APPLOG_NO_CREDIT,
+        APPLOG_DISPENSED, APPLOG_CHANGE, APPLOG_EXACT_CHANGE, APPLOG_BUSY,
+    };
+    uint32_t seed = TEST_SEED;
+
+    catalog_init();
+
+    /* Shorter rows whose end matches the old row */
+    check_row("AXC_", "ABC");
+    check_row("Credit: 10.50 EUR", "Credit: 1.50 EUR");
+    check_row("0.50 EUR change", "0.50 EUR");
+    check_row("Not enough credit", "Not enough");
+    check_row("abcdef", "");
+    check_row("", "xyz");
+    check_row("Coke dispensed", "Beer dispensed");
+
+    for (int i = 0; i < TEST_RECORDS; i++) {
+        struct applog_record rec;
+
+        seed = seed * 1103515245 + 12345;
+        rec.id = ids[(seed >> 16) % ARRAY_SIZE(ids)];
+        rec.product = 1 + (seed >> 8) % CATALOG_SIZE;
+        rec.credit = (seed >> 4) % 2000 / 10 * 10;
+        if (rec.id == APPLOG_EXACT_CHANGE) {
+            rec.credit = (seed >> 20) & 1;
+        }
+        display_apply(&rec);
+        /* Coalesce up to four records in a frame */
+        if ((seed >> 24) % 4 == 0) {
+            display_flush();
+            check_screen("stream");
+        }
+        if (failures > 10) {
+            break;
+        }
+    }
+    display_flush();
+    check_screen("stream end");
+
+    printf("display_test: %s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1 @@
+/* printk is declared by the host zephyr.h */
@@ -0,0 +1,49 @@
+/** @file zephyr.h
+ * @brief Host replacement of the Zephyr definitions used by the host tests
+ *
+ * Adds the printk family, the interrupt lock and
+ * the atomic variables to the definitions of the
+ * fleet simulator; printk goes to host_printk()
+ * of the test, which keeps what the module under
+ * test sends. A host program has no interrupts
+ * to lock.
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#ifndef HOST_TEST_ZEPHYR_H
+#define HOST_TEST_ZEPHYR_H
+
+#include_next <zephyr.h>
+
+#include <stdio.h>
+
+void host_printk(const char *fmt, ...);
+
+#define printk host_printk
+#define snprintk snprintf
+#define vsnprintk vsnprintf
+
+static inline unsigned int irq_lock(void){
+    return 0;
+}
+
+static inline void irq_unlock(unsigned int key){
+}
+
+typedef long atomic_t;
+typedef atomic_t atomic_val_t;
+
+#define ATOMIC_INIT(i) (i)
+
+static inline atomic_val_t atomic_get(const atomic_t *target){
+    return __atomic_load_n(target, __ATOMIC_SEQ_CST);
+}
+
+static inline atomic_val_t atomic_set(atomic_t *target, atomic_val_t value){
+    return __atomic_exchange_n(target, value, __ATOMIC_SEQ_CST);
+}
+
+#endif /* HOST_TEST_ZEPHYR_H */
@@ -0,0 +1,176 @@
+/** @file isr_bench.c
+ * @brief Host comparison of eight button callbacks and a single one
+ *
+ * Times the GPIO interrupt of the buttons the two
+ * ways main.c has registered it: one
+ * gpio_callback per button, as the original code
+ * did, or a single callback for BUTTONS_MASK, as
+ * buttons_cbfunction now is. The callbacks are
+ * fired by a copy of gpio_fire_callbacks() of
+ * Zephyr 2.7 (drivers/gpio/gpio_utils.h), which
+ * the nRF GPIO driver calls once per interrupt
+ * with the mask of the pins that fired, and both
+ * ways hand the same pins to the same edge
+ * function. The same hook, timing_counter_get()
+ * before and after gpio_fire_callbacks(), times
+ * both.
+ *
+ * Prints the average, best and worst time of an
+ * interrupt of one button and of all eight at
+ * once, and the same for an empty list, the cost
+ * of the hook itself. The worst is the host
+ * scheduler more than the walk. The host CPU is not the Cortex-M4 of the
+ * board: the numbers compare the two ways, they
+ * are not the ISR time of the board.
+ *
+ * Usage: isr_bench [interrupts]
+ *
+ * @author Mattia Longo and Giacomo Bego
+ * @date 17 May 2022
+ * @bug No known bugs
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <zephyr.h>
+#include <timing/timing.h>
+
+#include "vending.h"
+
+#define ISR_BUTTONS VENDING_BUTTONS /* BUT1 ... BUT8 */
+#define ISR_RUNS 1000000 /* Default number of interrupts of each kind */
+#define ISR_WARMUP 1000 /* Interrupts fired before timing */
+
+struct device;
+struct gpio_callback;
+
+typedef void (*gpio_callback_handler_t)(const struct device *port, struct gpio_callback *cb,
+                                        uint32_t pins);
+
+/* Layout of struct gpio_callback, the list node is a plain pointer */
+struct gpio_callback {
+    struct gpio_callback *next; /* Next callback of the port */
+    gpio_callback_handler_t handler; /* Called when a pin of pin_mask fires */
+    uint32_t pin_mask; /* Pins served by the callback */
+};
+
+static const uint8_t button_pins[ISR_BUTTONS] = {
+    BOARDBUT1, BOARDBUT2, BOARDBUT3, BOARDBUT4, BOARDBUT5, BOARDBUT6, BOARDBUT7, BOARDBUT8,
+};
+
+static struct gpio_callback per_pin_cb[ISR_BUTTONS]; /* One callback per button */
+static struct gpio_callback single_cb; /* One callback for all the buttons */
+static volatile uint32_t edges; /* Pins handed to the debounce, stands for debounce_edge() */
+static uint32_t buttons_mask; /* BUTTONS_MASK */
+
+/**
+ * @brief button_edge function pass the pins to the debounce
+ *
+ * @param pins pins that fired
+ */
+
+static __attribute__((noinline)) void button_edge(uint32_t pins){
+    edges |= pins;
+}
+
+/**
+ * @brief per_pin_cbfunction function callback of one button
+ *
+ * @param port GPIO device
+ * @param cb callback of the button
+ * @param pins pins of the callback that fired
+ */
+
+static void per_pin_cbfunction(const struct device *port, struct gpio_callback *cb, uint32_t pins){
+    button_edge(pins);
+}
+
+/**
+ * @brief single_cbfunction function callback of all the buttons
+ *
+ * @param port GPIO device
+ * @param cb callback of the buttons
+ * @param pins pins of the callback that fired
+ */
+
+static void single_cbfunction(const struct device *port, struct gpio_callback *cb, uint32_t pins){
+    button_edge(pins & buttons_mask);
+}
+
+/**
+ * @brief gpio_fire_callbacks function call the callbacks of the pins that fired
+ *
+ * Same walk as gpio_fire_callbacks() of Zephyr.
+ *
+ * @param list first callback of the port
+ * @param port GPIO device
+ * @param pins pins that fired
+ */
+
+static __attribute__((noinline)) void gpio_fire_callbacks(struct gpio_callback *list,
+                                                          const struct device *port, uint32_t pins){
+    struct gpio_callback *cb, *tmp;
+
+    for (cb = list; cb != NULL; cb = tmp) {
+        tmp = cb->next;
+        if (cb->pin_mask & pins) {
+            cb->handler(port, cb, cb->pin_mask & pins);
+        }
+    }
+}
+
+/**
+ * @brief isr_measure function time the interrupts of one registration
+ *
+ * @param name name printed
+ * @param list first callback of the port
+ * @param runs interrupts of each kind
+ */
+
+static void isr_measure(const char *name, struct gpio_callback *list, unsigned runs){
+    unsigned seed = 1; /* Same pins for both registrations */
+
+    for (int all = 0; all <= 1; all++) {
+        uint64_t total = 0, best = UINT64_MAX, worst = 0;
+
+        for (unsigned i = 0; i < ISR_WARMUP + runs; i++) {
+            uint32_t pins = all ? buttons_mask : BIT(button_pins[rand_r(&seed) % ISR_BUTTONS]);
+            timing_t start = timing_counter_get();
+
+            gpio_fire_callbacks(list, NULL, pins);
+
+            timing_t end = timing_counter_get();
+            uint64_t ns = timing_cycles_to_ns(timing_cycles_get(&start, &end));
+
+            if (i >= ISR_WARMUP) {
+                total += ns;
+                best = MIN(best, ns);
+                worst = MAX(worst, ns);
+            }
+        }
+        printf("%-6s %-9s avg %3u ns min %3u ns max %7u ns\n", name, all ? "8 buttons" : "1 button",
+               (uint32_t)(total / runs), (uint32_t)best, (uint32_t)worst);
+    }
+}
+
+int main(int argc, char **argv){
+    unsigned runs = ISR_RUNS;
+
+    if (argc > 1) {
+        runs = MAX(1, atoi(argv[1]));
+    }
+    for (int i = ISR_BUTTONS - 1; i >= 0; i--) {
+        buttons_mask |= BIT(button_pins[i]);
+        per_pin_cb[i].handler = per_pin_cbfunction;
+        per_pin_cb[i].pin_mask = BIT(button_pins[i]);
+        per_pin_cb[i].next = i + 1 < ISR_BUTTONS ? &per_pin_cb[i + 1] : NULL;
+    }
+    single_cb.handler = single_cbfunction;
+    single_cb.pin_mask = buttons_mask;
+
+    isr_measure("hook", NULL, runs);
+    isr_measure("8 cb", &per_pin_cb[0], runs);
+    isr_measure("1 cb", &single_cb, runs);
+    return edges == buttons_mask ? 0 : 1;
+}
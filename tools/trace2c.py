@@ -0,0 +1,42 @@
+#!/usr/bin/env python3
+"""Turn a trace dumped with 'D' on the console into src/trace_data.h.
+
+Reads the console capture from a file or stdin, takes the presses (P)
+and commands (C) between TRACE BEGIN and TRACE END, drops the raw edges
+(E), which the debounce already turned into presses, and writes the C
+table replayed by src/replay.c (CONFIG_APP_TRACE_REPLAY).
+
+Usage: trace2c.py [capture.txt] > src/trace_data.h
+"""
+
+import sys
+
+
+def main():
+    f = open(sys.argv[1], encoding="utf-8", errors="replace") if len(sys.argv) > 1 else sys.stdin
+    steps = []
+    inside = False
+    for line in f:
+        words = line.split()
+        if words[:2] == ["TRACE", "BEGIN"]:
+            inside = True
+            steps = []
+        elif words[:2] == ["TRACE", "END"]:
+            inside = False
+        elif inside and len(words) == 3 and words[2] in ("P", "C"):
+            steps.append((int(words[0]), int(words[1])))
+
+    if not steps:
+        sys.exit("no presses found in the trace")
+    start = steps[0][0]
+
+    print("/* Generated by tools/trace2c.py, %d presses */" % len(steps))
+    print()
+    print("static const struct trace_step trace_data[] = {")
+    for us, pin in steps:
+        print("    { %d, %d }," % (us - start, pin))
+    print("};")
+
+
+if __name__ == "__main__":
+    main()